@@ -39,6 +39,11 @@ void VKTriangleApp::createInstance()
                                             // not available!
 
     auto requiredExtensions = getRequiredExtensions(enableValidationLayers);
+    for (const char *extension : requiredExtensions) {
+        if (strcmp(extension, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+            properties2Enabled = true;
+        }
+    }
 
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -69,7 +74,7 @@ void VKTriangleApp::createInstance()
         createInfo.enabledLayerCount = 0;
         createInfo.pNext = nullptr;
     }
-    VK_CHECK(vkCreateInstance(&createInfo, nullptr, &instance));
+    VK_CHECK(vkCreateInstance(&createInfo, VULKAN_CPU_ALLOCATOR, &instance));
 
     uint32_t extensionCount = 0;
     vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
@@ -216,15 +221,26 @@ void VKTriangleApp::createLogicalDevicesAndQueue()
 
     VkPhysicalDeviceFeatures deviceFeatures{};
 
+    std::vector<const char *> extensions = deviceExtensions;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timelineSemaphoreSupported = VKFrameSync::isTimelineSupported(physicalDevice,
+                                                                  properties2Enabled);
+    if (timelineSemaphoreSupported) {
+        extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount =
         static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.pNext = timelineSemaphoreSupported ? &timelineFeatures : nullptr;
     createInfo.pEnabledFeatures = &deviceFeatures;
     createInfo.enabledExtensionCount =
-        static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
     if (enableValidationLayers) {
         createInfo.enabledLayerCount =
             static_cast<uint32_t>(validationLayers.size());
@@ -233,7 +249,9 @@ void VKTriangleApp::createLogicalDevicesAndQueue()
         createInfo.enabledLayerCount = 0;
     }
 
-    VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device));
+    VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, VULKAN_CPU_ALLOCATOR, &device));
+    // no shader module identifiers, the sample only has one pipeline.
+    shaderCache.setDevice(device, VKShaderIdentifierSupport{});
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
@@ -281,18 +299,16 @@ void VKTriangleApp::createSwapChain()
     // Please check
     // https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkPresentModeKHR.html
     // for a discourse on different present modes.
-    //
-    // VK_PRESENT_MODE_FIFO_KHR = Hard Vsync
-    // This is always supported on Android phones
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > swapChainSupport.capabilities.maxImageCount) {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    VKPresentConfig presentConfig =
+        presentPolicy.choose(requestedPresentGoal, swapChainSupport);
+    VkPresentModeKHR presentMode = presentConfig.presentMode;
+    uint32_t imageCount = presentConfig.imageCount;
     pretransformFlag = swapChainSupport.capabilities.currentTransform;
 
+    // still valid when retired by recreateSwapChain(), its images are
+    // handed over to the new swapchain.
+    VkSwapchainKHR oldSwapChain = swapChain;
+
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     createInfo.surface = surface;
@@ -320,9 +336,9 @@ void VKTriangleApp::createSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = oldSwapChain;
 
-    VK_CHECK(vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain));
+    VK_CHECK(vkCreateSwapchainKHR(device, &createInfo, VULKAN_CPU_ALLOCATOR, &swapChain));
 
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
@@ -352,7 +368,7 @@ void VKTriangleApp::createImageViews() {
         createInfo.subresourceRange.levelCount = 1;
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
-        VK_CHECK(vkCreateImageView(device, &createInfo, nullptr,
+        VK_CHECK(vkCreateImageView(device, &createInfo, VULKAN_CPU_ALLOCATOR,
                                 &swapChainImageViews[i]));
     }
 
@@ -390,47 +406,52 @@ void VKTriangleApp::createRenderPass() {
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+    std::vector<VkAttachmentDescription> attachments = {colorAttachment};
+
+    VkAttachmentReference depthAttachmentRef{};
+    if (enableDepthBuffer) {
+        depthAttachment.init(physicalDevice, device, &memoryAllocator);
+        attachments.push_back(depthAttachment.getAttachmentDescription());
+
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        // one depth image is shared by all frames in flight, the clear must
+        // wait for the depth writes of the previous frame.
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
+
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
+    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, VULKAN_CPU_ALLOCATOR, &renderPass));
 }
 
+/*
+ * The layouts come from the reflection of the pipeline's shaders, see
+ * vk_layout_cache.h. The uniform buffer is bound with a dynamic offset.
+ */
 void VKTriangleApp::createDescriptorSetLayout() {
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
-
-    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
-                                        &descriptorSetLayout));
-}
+    VKPipelineInterface interface;
+    interface.add(shaderCache.getReflection(vertexShader));
+    interface.add(shaderCache.getReflection(fragmentShader));
 
-VkShaderModule VKTriangleApp::createShaderModule(const std::vector<uint8_t> &code) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
+    descriptorSetLayout = layoutCache.getSetLayout(interface, 0);
+    pipelineLayout = layoutCache.getPipelineLayout(interface);
 
-    // Satisifies alignment requirements since the allocator
-    // in vector ensures worst case requirements
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-    VkShaderModule shaderModule;
-    VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule));
-
-    return shaderModule;
+    return;
 }
 
 /*
@@ -456,152 +477,98 @@ VkShaderModule VKTriangleApp::createShaderModule(const std::vector<uint8_t> &cod
  *  - The pipeline layout sends 1 uniform buffer object to the shader containing
  * a 4x4 rotation matrix specified by the descriptorSetLayout. This is required
  * in order to render a rotated scene when the device has been rotated.
+ *
+ * The fixed function state lives in VKPipelineRegistry, the app only fills in
+ * the VKPipelineState that differs, see getPipelineState().
  */
 void VKTriangleApp::createGraphicsPipeline() {
-    auto vertShaderCode =
-        LoadBinaryFileToVector("shaders/000_shader.vert.spv", assetManager);
-    auto fragShaderCode =
-        LoadBinaryFileToVector("shaders/000_shader.frag.spv", assetManager);
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-                                                        fragShaderStageInfo};
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.pVertexBindingDescriptions = nullptr;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-    vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    // draws triangle here.
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-                                    &pipelineLayout));
-    std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT,
-                                                        VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicStateCI{};
-    dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
-    dynamicStateCI.dynamicStateCount =
-        static_cast<uint32_t>(dynamicStateEnables.size());
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicStateCI;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                        nullptr, &graphicsPipeline));
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    // compiles in the background, see resolvePipeline().
+    pipelineHandle = pipelineRegistry.request(getPipelineState());
+    graphicsPipeline = VK_NULL_HANDLE;
+
+    return;
+}
+
+/*
+ * Picks up the pipeline once its background compile is done. Until then
+ * graphicsPipeline is VK_NULL_HANDLE and the draws are skipped, so the
+ * cached recordings are redone when it changes. The compile job invalidates
+ * the app when it finishes, see initVulkan().
+ */
+void VKTriangleApp::resolvePipeline()
+{
+    VkPipeline pipeline = pipelineRegistry.resolve(pipelineHandle);
+    if (pipeline != graphicsPipeline) {
+        graphicsPipeline = pipeline;
+        commandBufferCache.invalidate();
+    }
+
+    return;
+}
+
+/*
+ * The swapchain format can change with the surface, the render pass and
+ * every pipeline created for it are not compatible with the new one.
+ */
+void VKTriangleApp::recreateRenderPass()
+{
+    uint64_t retireValue = frameSync.getSubmittedValue() + framesInFlight;
+
+    pipelineRegistry.retire(renderPass, deletionQueue, retireValue);
+    VkDevice device = this->device;
+    VkRenderPass oldRenderPass = renderPass;
+    deletionQueue.push(retireValue, [device, oldRenderPass]() {
+        vkDestroyRenderPass(device, oldRenderPass, VULKAN_CPU_ALLOCATOR);
+    });
+
+    createRenderPass();
+    pipelineHandle = pipelineRegistry.request(getPipelineState());
+    graphicsPipeline = VK_NULL_HANDLE;
+
+    return;
+}
+
+VKPipelineState VKTriangleApp::getPipelineState()
+{
+    VKPipelineState state;
+    state.vertexShader = vertexShader;
+    state.fragmentShader = fragmentShader;
+    state.specialization.setFloat(SPEC_CONSTANT_COLOR_R, triangleColor.r);
+    state.specialization.setFloat(SPEC_CONSTANT_COLOR_G, triangleColor.g);
+    state.specialization.setFloat(SPEC_CONSTANT_COLOR_B, triangleColor.b);
+    state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    state.depthTest = enableDepthBuffer;
+    state.depthWrite = enableDepthBuffer;
+    state.layout = pipelineLayout;
+    state.renderPass = renderPass;
+
+    return state;
 }
 
 void VKTriangleApp::createFramebuffers() {
+    // the depth image follows the swapchain extent, it is recreated here
+    // and destroyed in cleanupSwapChain().
+    if (enableDepthBuffer) {
+        depthAttachment.create(swapChainExtent);
+    }
+
     swapChainFramebuffers.resize(swapChainImageViews.size());
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {swapChainImageViews[i]};
+        std::vector<VkImageView> attachments = {swapChainImageViews[i]};
+        if (enableDepthBuffer) {
+            attachments.push_back(depthAttachment.getView());
+        }
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
         framebufferInfo.width = swapChainExtent.width;
         framebufferInfo.height = swapChainExtent.height;
         framebufferInfo.layers = 1;
 
-        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, nullptr,
+        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, VULKAN_CPU_ALLOCATOR,
                                     &swapChainFramebuffers[i]));
     }
 }
@@ -612,20 +579,14 @@ void VKTriangleApp::createCommandPool() {
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR, &commandPool));
 
     return;
 }
 
 void VKTriangleApp::createCommandBuffer() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = commandBuffers.size();
-
-    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()));
+    // command buffers are allocated on first use, per frame slot and image.
+    commandBufferCache.init(device, commandPool, MAX_FRAMES_IN_FLIGHT);
 
     return;
 }
@@ -638,27 +599,24 @@ void VKTriangleApp::createCommandBuffer() {
  */
 void VKTriangleApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                            VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                           VkDeviceMemory &bufferMemory) {
+                           VKAllocation &bufferAllocation) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    VK_CHECK(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer));
+    VK_CHECK(vkCreateBuffer(device, &bufferInfo, VULKAN_CPU_ALLOCATOR, &buffer));
 
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex =
+    uint32_t memoryTypeIndex =
         findMemoryType(memRequirements.memoryTypeBits, properties);
+    VK_CHECK(memoryAllocator.allocate(memRequirements, memoryTypeIndex, bufferAllocation));
 
-    VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory));
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    VK_CHECK(vkBindBufferMemory(device, buffer, bufferAllocation.memory,
+                                bufferAllocation.offset));
 }
 
 /*
@@ -684,112 +642,164 @@ uint32_t VKTriangleApp::findMemoryType(uint32_t typeFilter,
 }
 
 void VKTriangleApp::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    // one region per frame in flight, each big enough for the uniform data
+    // of many objects.
+    VkDeviceSize bytesPerFrame = 64 * 1024;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    uniformBuffers[i], uniformBuffersMemory[i]);
-    }
+    uniformRingBuffer.init(physicalDevice, device, &memoryAllocator,
+                           bytesPerFrame, MAX_FRAMES_IN_FLIGHT);
 }
 
 void VKTriangleApp::createDescriptorPool() {
     VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = 1;
     poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = 1;
 
-    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR, &descriptorPool));
 }
 
 void VKTriangleApp::createDescriptorSets() {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-                                                descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
-
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()));
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkWriteDescriptorSet descriptorWrite{};
-        // Uniform buffer
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = descriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
-
-        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-    }
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+
+    // a single descriptor set serves every frame, the frame's slice of the
+    // uniform ring buffer is selected with a dynamic offset at bind time.
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformRingBuffer.getBuffer();
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    VkWriteDescriptorSet descriptorWrite{};
+    // Uniform buffer
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 void VKTriangleApp::createSyncObjects() {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VULKAN_CPU_ALLOCATOR,
                                 &imageAvailableSemaphores[i]));
 
-        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VULKAN_CPU_ALLOCATOR,
                                 &renderFinishedSemaphores[i]));
-
-        VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]));
     }
+    frameSync.init(device, timelineSemaphoreSupported, MAX_FRAMES_IN_FLIGHT);
+    frameLatency.reset(framesInFlight);
 }
 
+/*
+ * Runs the init steps as a VKInitGraph, see vk_init_graph.h. Each node lists
+ * the nodes it reads the results of.
+ */
 void VKTriangleApp::initVulkan()
 {
-    createInstance();
-    VKBaseApp::createSurface();
-    pickPhysicalDevice();
-    createLogicalDevicesAndQueue();
-    VKBaseApp::setupDebugMessenger();
-    establishDisplaySizeIdentity();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();    
-    createGraphicsPipeline();
-    createFramebuffers(); 
-    createCommandPool();
-    createCommandBuffer();
-    createSyncObjects();
+    initJobSystem();
+    // before the graph, the device node validates what it loads.
+    shaderCache.init(assetManager, getShaderIdentifierPath());
+
+    VKInitGraph graph;
+    VKInitNode shaders = graph.add("prefetch shaders", [this] {
+        shaderCache.prefetch({vertexShader, fragmentShader}, jobSystem);
+    });
+    VKInitNode instance = graph.add("instance", [this] {
+        createInstance();
+    });
+    graph.add("debug messenger", [this] {
+        VKBaseApp::setupDebugMessenger();
+    }, {instance});
+    VKInitNode surface = graph.add("surface", [this] {
+        VKBaseApp::createSurface();
+    }, {instance});
+    VKInitNode logicalDevice = graph.add("device", [this] {
+        pickPhysicalDevice();
+        createLogicalDevicesAndQueue();
+    }, {surface});
+    VKInitNode allocators = graph.add("allocators", [this] {
+        memoryAllocator.init(physicalDevice, device);
+    }, {logicalDevice});
+    VKInitNode swapchain = graph.add("swapchain", [this] {
+        establishDisplaySizeIdentity();
+        createSwapChain();
+        createImageViews();
+    }, {logicalDevice});
+    VKInitNode renderPassNode = graph.add("render pass", [this] {
+        createRenderPass();
+    }, {allocators, swapchain});
+    VKInitNode descriptors = graph.add("descriptors", [this] {
+        layoutCache.init(device);
+        createDescriptorSetLayout();
+        createUniformBuffers();
+        createDescriptorPool();
+        createDescriptorSets();
+    }, {shaders, allocators});
+    VKInitNode cache = graph.add("pipeline cache", [this] {
+        pipelineCache.init(physicalDevice, device, getPipelineCachePath());
+        // a finished compile changes what the next frame draws.
+        pipelineRegistry.init(device, &pipelineCache, &shaderCache, &jobSystem,
+                              &dynamicState, [this] { invalidateAsync(); });
+    }, {logicalDevice});
+    VKInitNode pipeline = graph.add("pipeline", [this] {
+        createGraphicsPipeline();
+    }, {shaders, cache, renderPassNode, descriptors});
+    VKInitNode framebuffers = graph.add("framebuffers", [this] {
+        createFramebuffers();
+    }, {renderPassNode});
+    graph.add("command buffers", [this] {
+        createCommandPool();
+        createCommandBuffer();
+    }, {pipeline, framebuffers});
+    graph.add("sync objects", [this] {
+        createSyncObjects();
+    }, {logicalDevice});
+
+    graph.run(jobSystem);
+    graph.logReport();
+    VKHostAllocator::get().logStats("init");
 
     initialized = true;
     return;
 }
 
+/*
+ * Resources of all MAX_FRAMES_IN_FLIGHT frames always exist, only the number
+ * of slots render() cycles through changes. Once the device is idle every
+ * submitted frame value has completed, so the slots can be renumbered from 0.
+ */
+void VKTriangleApp::applyFramesInFlight()
+{
+    vkDeviceWaitIdle(device);
+    LOGI("frames in flight %u -> %u", framesInFlight, requestedFramesInFlight);
+    framesInFlight = requestedFramesInFlight;
+    currentFrame = 0;
+    frameLatency.reset(framesInFlight);
+
+    return;
+}
+
 void VKTriangleApp::onOrientationChange()
 {
     recreateSwapChain();
@@ -824,24 +834,28 @@ void VKTriangleApp::recordCommandBuffer(VkCommandBuffer commandBuffer,
     scissor.extent = swapChainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    static float grey;
-    grey += 0.005f;
-    if (grey > 1.0f) {
-        grey = 0.0f;
-    }
-    VkClearValue clearColor = {{{grey, grey, grey, 1.0f}}};
+    // the animated background is drawn from ubo.clearColor, so the
+    // recording does not change from frame to frame.
+    VkClearValue clearValues[2];
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
 
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    renderPassInfo.clearValueCount = enableDepthBuffer ? 2 : 1;
+    renderPassInfo.pClearValues = clearValues;
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
                         VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        graphicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descriptorSets[currentFrame],
-                            0, nullptr);
-
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    // still compiling, only the clear is recorded.
+    if (graphicsPipeline != VK_NULL_HANDLE) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            graphicsPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelineLayout, 0, 1, &descriptorSet,
+                                1, &frameUniforms.offset);
+
+        // vertices 3..5 are the fullscreen background, 0..2 the triangle.
+        vkCmdDraw(commandBuffer, 3, 1, 3, 0);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
     vkCmdEndRenderPass(commandBuffer);
     VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
@@ -850,26 +864,50 @@ void VKTriangleApp::recordCommandBuffer(VkCommandBuffer commandBuffer,
 
 void VKTriangleApp::updateUniformBuffer(uint32_t currentImage) 
 {
-    SwapChainSupportDetails swapChainSupport =
-        querySwapChainSupport(physicalDevice);
+    // only the capabilities are needed here, querySwapChainSupport() would
+    // also enumerate formats and present modes into vectors every frame.
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
     UniformBufferObject ubo{};
-    getGlmPrerotationMatrix(swapChainSupport.capabilities, pretransformFlag,
+    getGlmPrerotationMatrix(capabilities, pretransformFlag,
                         ubo.mvp, 1.0f, 1.0f, 1.0f);
-    void *data;
-    vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0,
-                &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+
+    static float grey;
+    grey += 0.005f;
+    if (grey > 1.0f) {
+        grey = 0.0f;
+    }
+    ubo.clearColor = glm::vec4(grey, grey, grey, 1.0f);
+    // the background animates, the next frame is different again.
+    invalidate();
+    // the GPU is done with this frame's region, see render().
+    uniformRingBuffer.beginFrame(currentImage);
+    frameUniforms = uniformRingBuffer.allocate(sizeof(ubo));
+    memcpy(frameUniforms.data, &ubo, sizeof(ubo));
 }
 
 void VKTriangleApp::render()
 {
+    swapchainHitch.onFrame();
+    dirty = false;
+
     if (orientationChanged) {
         onOrientationChange();
     }
 
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE,
-                    UINT64_MAX);
+    if (framesInFlight != requestedFramesInFlight) {
+        applyFramesInFlight();
+    }
+
+    if (presentPolicy.getGoal() != requestedPresentGoal) {
+        recreateSwapChain();
+    }
+
+    frameLatency.poll(frameSync.getCompletedValue());
+    frameSync.waitForSlot(currentFrame);
+    frameLatency.onComplete(currentFrame);
+    deletionQueue.collect(frameSync.getCompletedValue());
+    presentPolicy.beginFrame();
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(
         device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
@@ -882,10 +920,17 @@ void VKTriangleApp::render()
             result == VK_SUBOPTIMAL_KHR);  // failed to acquire swap chain image
     updateUniformBuffer(currentFrame);
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    resolvePipeline();
+    if (!enableCommandBufferCache) {
+        commandBufferCache.invalidate();
+    }
+    // the dynamic uniform offset is baked into the recording.
+    bool upToDate = false;
+    VkCommandBuffer commandBuffer = commandBufferCache.get(
+        currentFrame, imageIndex, frameUniforms.offset, upToDate);
+    if (!upToDate) {
+        recordCommandBuffer(commandBuffer, imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -897,13 +942,13 @@ void VKTriangleApp::render()
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo,
-                            inFlightFences[currentFrame]));
+    uint64_t frameValue = frameSync.submit(graphicsQueue, currentFrame, submitInfo);
+    frameLatency.onSubmit(currentFrame, frameValue);
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -918,6 +963,7 @@ void VKTriangleApp::render()
     presentInfo.pResults = nullptr;
 
     result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    presentPolicy.endFrame();
     if (result == VK_SUBOPTIMAL_KHR) {
         orientationChanged = true;
     } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -925,7 +971,7 @@ void VKTriangleApp::render()
     } else {
         assert(result == VK_SUCCESS);  // failed to present swap chain image!
     }
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % framesInFlight;
 
     return;
 }
@@ -933,26 +979,30 @@ void VKTriangleApp::render()
 void VKTriangleApp::cleanup()
 {
     vkDeviceWaitIdle(device);
+    deletionQueue.flush();
+    presentPolicy.logStats();
     cleanupSwapChain();
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, VULKAN_CPU_ALLOCATOR);
 
-    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    uniformRingBuffer.destroy();
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], VULKAN_CPU_ALLOCATOR);
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], VULKAN_CPU_ALLOCATOR);
     }
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
-    }
-    vkDestroyCommandPool(device, commandPool, nullptr);
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
-    vkDestroyDevice(device, nullptr);
+    frameSync.destroy();
+    commandBufferCache.logStats();
+    commandBufferCache.destroy();
+    vkDestroyCommandPool(device, commandPool, VULKAN_CPU_ALLOCATOR);
+    pipelineRegistry.logStats();
+    pipelineRegistry.destroy();
+    layoutCache.logStats();
+    layoutCache.destroy();
+    shaderCache.destroy();
+    pipelineCache.destroy();
+    vkDestroyRenderPass(device, renderPass, VULKAN_CPU_ALLOCATOR);
+    memoryAllocator.destroy();
+    vkDestroyDevice(device, VULKAN_CPU_ALLOCATOR);
     VKBaseApp::cleanup();
 
     return;
@@ -961,25 +1011,77 @@ void VKTriangleApp::cleanup()
 void VKTriangleApp::cleanupSwapChain()
 {
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-        vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+        vkDestroyFramebuffer(device, swapChainFramebuffers[i], VULKAN_CPU_ALLOCATOR);
     }
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+        vkDestroyImageView(device, swapChainImageViews[i], VULKAN_CPU_ALLOCATOR);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    swapChainFramebuffers.clear();
+    swapChainImageViews.clear();
+
+    depthAttachment.destroy();
+
+    vkDestroySwapchainKHR(device, swapChain, VULKAN_CPU_ALLOCATOR);
+    swapChain = VK_NULL_HANDLE;
+
+    return;
+}
+
+/*
+ * Hands the swapchain and everything built on it to the deletion queue.
+ * Frames submitted so far still render into its framebuffers and the
+ * presentation engine may still hold its images, which is only known to be
+ * over once framesInFlight more frames have completed.
+ */
+void VKTriangleApp::retireSwapChain()
+{
+    uint64_t retireValue = frameSync.getSubmittedValue() + framesInFlight;
+
+    VkDevice device = this->device;
+    VkSwapchainKHR oldSwapChain = swapChain;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkImageView> imageViews;
+    framebuffers.swap(swapChainFramebuffers);
+    imageViews.swap(swapChainImageViews);
+    deletionQueue.push(retireValue, [device, oldSwapChain, framebuffers, imageViews]() {
+        for (VkFramebuffer framebuffer : framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, VULKAN_CPU_ALLOCATOR);
+        }
+        for (VkImageView imageView : imageViews) {
+            vkDestroyImageView(device, imageView, VULKAN_CPU_ALLOCATOR);
+        }
+        vkDestroySwapchainKHR(device, oldSwapChain, VULKAN_CPU_ALLOCATOR);
+    });
+    depthAttachment.retire(deletionQueue, retireValue);
 
     return;
 }
 
 void VKTriangleApp::recreateSwapChain()
 {
-    vkDeviceWaitIdle(device);
-    cleanupSwapChain();
+    if (enableDeferredSwapchainRecreation) {
+        // swapChain stays alive until createSwapChain() passed it as oldSwapchain.
+        retireSwapChain();
+        swapchainHitch.begin("deferred swapchain recreation");
+    } else {
+        vkDeviceWaitIdle(device);
+        cleanupSwapChain();
+        swapchainHitch.begin("idle swapchain recreation");
+    }
+    VkFormat oldFormat = swapChainImageFormat;
     createSwapChain();
     createImageViews();
+    if (swapChainImageFormat != oldFormat) {
+        recreateRenderPass();
+    }
     createFramebuffers();
+    VKHostAllocator::get().logStats("swapchain recreation");
+    // the frame that hit the recreation was not presented.
+    invalidate();
+    // the recordings reference the old framebuffers and extent.
+    commandBufferCache.invalidate();
 
     return;
 }
@@ -988,6 +1090,11 @@ void VKTriangleApp::reset(ANativeWindow *newWindow, AAssetManager *newManager)
 {
     VKBaseApp::reset(newWindow, newManager);
     if (initialized) {
+        // the new window comes with a new surface, the swapchain of the old
+        // one can't be passed as oldSwapchain.
+        vkDeviceWaitIdle(device);
+        deletionQueue.flush();
+        cleanupSwapChain();
         recreateSwapChain();
     }
 
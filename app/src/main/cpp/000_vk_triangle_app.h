@@ -21,6 +21,7 @@ class VKTriangleApp : public VKBaseApp
         void createRenderPass();
         void createDescriptorSetLayout();
         void createGraphicsPipeline();
+        VKPipelineState getPipelineState();
         void createFramebuffers();
         void createCommandPool();
         void createCommandBuffer();
@@ -32,15 +33,18 @@ class VKTriangleApp : public VKBaseApp
         bool isDeviceSuitable(VkPhysicalDevice device);
         bool checkValidationLayerSupport();
 
-        VkShaderModule createShaderModule(const std::vector<uint8_t> &code);
         void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
         void recreateSwapChain();
+        void recreateRenderPass();
+        void resolvePipeline();
+        void retireSwapChain();
+        void applyFramesInFlight();
         void onOrientationChange();
         uint32_t findMemoryType(uint32_t typeFilter,
                                 VkMemoryPropertyFlags properties);
         void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                 VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                VkDeviceMemory &bufferMemory);
+                VKAllocation &bufferAllocation);
         void createUniformBuffers();
         void updateUniformBuffer(uint32_t currentImage);
         void createDescriptorPool();
@@ -58,26 +62,36 @@ class VKTriangleApp : public VKBaseApp
         VkRenderPass renderPass;
         VkDescriptorSetLayout descriptorSetLayout;
         VkPipelineLayout pipelineLayout;
-        VkPipeline graphicsPipeline;
+        // constant, read by init graph nodes that run before the render pass
+        // or the layouts exist.
+        const char *vertexShader = "shaders/000_shader.vert.spv";
+        const char *fragmentShader = "shaders/000_shader.frag.spv";
+        VKPipelineHandle pipelineHandle = INVALID_PIPELINE_HANDLE;
+        // pipelineHandle resolved for this frame, VK_NULL_HANDLE while compiling.
+        VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+        // SPEC_CONSTANT_COLOR_R/G/B of the shaders, see vk_specialization.h.
+        glm::vec3 triangleColor = glm::vec3(0.67f, 0.1f, 0.2f);
 
-        std::vector<VkBuffer> uniformBuffers;
-        std::vector<VkDeviceMemory> uniformBuffersMemory;
+        // per-frame uniform data lives in one persistently mapped ring buffer,
+        // frameUniforms is this frame's UniformBufferObject inside of it.
+        VKUniformRingBuffer uniformRingBuffer;
+        VKUniformSlice frameUniforms;
 
         std::vector<VkSemaphore> imageAvailableSemaphores;
         std::vector<VkSemaphore> renderFinishedSemaphores;
-        std::vector<VkFence> inFlightFences;
         VkDescriptorPool descriptorPool;
-        std::vector<VkDescriptorSet> descriptorSets;
+        VkDescriptorSet descriptorSet;
 
-        VkSwapchainKHR swapChain;
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
         std::vector<VkImage> swapChainImages;
         VkFormat swapChainImageFormat;
         VkExtent2D swapChainExtent;
         VkExtent2D displaySizeIdentity;
         std::vector<VkImageView> swapChainImageViews;
         std::vector<VkFramebuffer> swapChainFramebuffers;
+        VKDepthAttachment depthAttachment;
         VkCommandPool commandPool;
-        std::vector<VkCommandBuffer> commandBuffers;
+        VKCommandBufferCache commandBufferCache;
 
         uint32_t currentFrame = 0;
         VkSurfaceTransformFlagBitsKHR pretransformFlag;
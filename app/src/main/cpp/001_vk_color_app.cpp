@@ -2,6 +2,7 @@
 #include <string>
 #include <set>
 #include <array>
+#include <chrono>
 
 #include "001_vk_color_app.h"
 
@@ -39,6 +40,11 @@ void VKColorApp::createInstance()
                                             // not available!
 
     auto requiredExtensions = getRequiredExtensions(enableValidationLayers);
+    for (const char *extension : requiredExtensions) {
+        if (strcmp(extension, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+            properties2Enabled = true;
+        }
+    }
 
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -69,7 +75,7 @@ void VKColorApp::createInstance()
         createInfo.enabledLayerCount = 0;
         createInfo.pNext = nullptr;
     }
-    VK_CHECK(vkCreateInstance(&createInfo, nullptr, &instance));
+    VK_CHECK(vkCreateInstance(&createInfo, VULKAN_CPU_ALLOCATOR, &instance));
 
     uint32_t extensionCount = 0;
     vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
@@ -94,25 +100,37 @@ QueueFamilyIndices VKColorApp::findQueueFamilies(VkPhysicalDevice device)
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+    // walk every family instead of stopping at the first complete match,
+    // a transfer-only family is usually listed after the graphics one.
     int i = 0;
     for (const auto &queueFamily : queueFamilies) {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+            !indices.graphicsFamily.has_value()) {
             indices.graphicsFamily = i;
         }
 
         VkBool32 presentSupport = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if (presentSupport) {
+        if (presentSupport && !indices.presentFamily.has_value()) {
             indices.presentFamily = i;
         }
 
-        if (indices.isComplete()) {
-            break;
+        // DMA engines are exposed as families with transfer but no graphics
+        // or compute support.
+        if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+            !indices.transferFamily.has_value()) {
+            indices.transferFamily = i;
         }
 
         i++;
     }
 
+    // graphics queues always support transfer operations.
+    if (!indices.transferFamily.has_value()) {
+        indices.transferFamily = indices.graphicsFamily;
+    }
+
     return indices;
 }
 
@@ -205,7 +223,8 @@ void VKColorApp::createLogicalDevicesAndQueue()
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-                                              indices.presentFamily.value()};
+                                              indices.presentFamily.value(),
+                                              indices.transferFamily.value()};
     float queuePriority = 1.f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
         VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -218,15 +237,41 @@ void VKColorApp::createLogicalDevicesAndQueue()
 
     VkPhysicalDeviceFeatures deviceFeatures{};
 
+    std::vector<const char *> extensions = deviceExtensions;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timelineSemaphoreSupported = VKFrameSync::isTimelineSupported(physicalDevice,
+                                                                  properties2Enabled);
+    if (timelineSemaphoreSupported) {
+        extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+    }
+    const void *next = timelineSemaphoreSupported ? &timelineFeatures : nullptr;
+
+    VKDynamicStateSupport dynamicStateSupport;
+    VKDynamicState::DeviceFeatures dynamicStateFeatures;
+    if (enableExtendedDynamicState) {
+        dynamicStateSupport = VKDynamicState::query(instance, physicalDevice);
+        VKDynamicState::enable(dynamicStateSupport, extensions, dynamicStateFeatures, &next);
+    }
+
+    VKShaderIdentifierSupport identifierSupport;
+    VKShaderCache::DeviceFeatures identifierFeatures;
+    if (enableShaderModuleIdentifiers) {
+        identifierSupport = VKShaderCache::query(instance, physicalDevice);
+        VKShaderCache::enable(identifierSupport, extensions, identifierFeatures, &next);
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount =
         static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.pNext = next;
     createInfo.pEnabledFeatures = &deviceFeatures;
     createInfo.enabledExtensionCount =
-        static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
     if (enableValidationLayers) {
         createInfo.enabledLayerCount =
             static_cast<uint32_t>(validationLayers.size());
@@ -235,10 +280,13 @@ void VKColorApp::createLogicalDevicesAndQueue()
         createInfo.enabledLayerCount = 0;
     }
 
-    VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device));
+    VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, VULKAN_CPU_ALLOCATOR, &device));
+    dynamicState.init(device, dynamicStateSupport);
+    shaderCache.setDevice(device, identifierSupport);
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
 
     return;
 }
@@ -284,18 +332,16 @@ void VKColorApp::createSwapChain()
     // Please check
     // https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkPresentModeKHR.html
     // for a discourse on different present modes.
-    //
-    // VK_PRESENT_MODE_FIFO_KHR = Hard Vsync
-    // This is always supported on Android phones
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > swapChainSupport.capabilities.maxImageCount) {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    VKPresentConfig presentConfig =
+        presentPolicy.choose(requestedPresentGoal, swapChainSupport);
+    VkPresentModeKHR presentMode = presentConfig.presentMode;
+    uint32_t imageCount = presentConfig.imageCount;
     pretransformFlag = swapChainSupport.capabilities.currentTransform;
 
+    // still valid when retired by recreateSwapChain(), its images are
+    // handed over to the new swapchain.
+    VkSwapchainKHR oldSwapChain = swapChain;
+
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     createInfo.surface = surface;
@@ -323,9 +369,9 @@ void VKColorApp::createSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = oldSwapChain;
 
-    VK_CHECK(vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain));
+    VK_CHECK(vkCreateSwapchainKHR(device, &createInfo, VULKAN_CPU_ALLOCATOR, &swapChain));
 
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
@@ -356,7 +402,7 @@ void VKColorApp::createImageViews()
         createInfo.subresourceRange.levelCount = 1;
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
-        VK_CHECK(vkCreateImageView(device, &createInfo, nullptr,
+        VK_CHECK(vkCreateImageView(device, &createInfo, VULKAN_CPU_ALLOCATOR,
                                 &swapChainImageViews[i]));
     }
 
@@ -395,49 +441,62 @@ void VKColorApp::createRenderPass()
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+    std::vector<VkAttachmentDescription> attachments = {colorAttachment};
+
+    VkAttachmentReference depthAttachmentRef{};
+    if (enableDepthBuffer) {
+        depthAttachment.init(physicalDevice, device, &memoryAllocator);
+        attachments.push_back(depthAttachment.getAttachmentDescription());
+
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        // one depth image is shared by all frames in flight, the clear must
+        // wait for the depth writes of the previous frame.
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
+
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
+    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, VULKAN_CPU_ALLOCATOR, &renderPass));
 }
 
+/*
+ * The layouts come from the reflection of the pipeline's shaders, see
+ * vk_layout_cache.h. The uniform buffer is bound with a dynamic offset. The
+ * push constant shaders have no descriptor set, their layout only has the
+ * push constant range. Both layouts exist for benchmarkTransforms().
+ */
 void VKColorApp::createDescriptorSetLayout()
 {
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
-
-    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
-                                        &descriptorSetLayout));
-}
+    VKPipelineInterface uniformInterface;
+    uniformInterface.add(shaderCache.getReflection(vertexShader));
+    uniformInterface.add(shaderCache.getReflection(fragmentShader));
+    descriptorSetLayout = layoutCache.getSetLayout(uniformInterface, 0);
+    uniformPipelineLayout = layoutCache.getPipelineLayout(uniformInterface);
 
-VkShaderModule VKColorApp::createShaderModule(const std::vector<uint8_t> &code)
-{
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
+    VKPipelineInterface pushInterface;
+    pushInterface.add(shaderCache.getReflection(pushVertexShader));
+    pushInterface.add(shaderCache.getReflection(fragmentShader));
+    assert(pushInterface.getSetCount() == 0);  // the push shaders read a descriptor!
+    pushPipelineLayout = layoutCache.getPipelineLayout(pushInterface);
 
-    // Satisifies alignment requirements since the allocator
-    // in vector ensures worst case requirements
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-    VkShaderModule shaderModule;
-    VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule));
+    pipelineLayout = enablePushConstantTransforms ? pushPipelineLayout : uniformPipelineLayout;
 
-    return shaderModule;
+    return;
 }
 
 /*
@@ -463,176 +522,106 @@ VkShaderModule VKColorApp::createShaderModule(const std::vector<uint8_t> &code)
  *  - The pipeline layout sends 1 uniform buffer object to the shader containing
  * a 4x4 rotation matrix specified by the descriptorSetLayout. This is required
  * in order to render a rotated scene when the device has been rotated.
+ *
+ * The fixed function state lives in VKPipelineRegistry, the app only fills in
+ * the VKPipelineState that differs, see getPipelineState().
  */
 void VKColorApp::createGraphicsPipeline()
 {
-    auto vertShaderCode =
-        LoadBinaryFileToVector("shaders/001_shader.vert.spv", assetManager);
-    auto fragShaderCode =
-        LoadBinaryFileToVector("shaders/001_shader.frag.spv", assetManager);
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-                                                        fragShaderStageInfo};
-
-    // (triangle.vert):
-    // layout (location = 0) in vec3 inPos;
-    // layout (location = 1) in vec3 inColor;
-    // Attribute location 0: Position
-    // Attribute location 1: Color
-    // vertex input bindding
-    VkVertexInputBindingDescription vertexInputBinding = {};
-    vertexInputBinding.binding   = 0; // Vertex Buffer 0
-    vertexInputBinding.stride    = sizeof(Vertex); // Position + Color
-    vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    std::vector<VkVertexInputAttributeDescription> vertexInputAttributs(2);
-    // position
-    vertexInputAttributs[0].binding  = 0;
-    vertexInputAttributs[0].location = 0; // triangle.vert : layout (location = 0)
-    vertexInputAttributs[0].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    vertexInputAttributs[0].offset   = 0;
-    // color
-    vertexInputAttributs[1].binding  = 0;
-    vertexInputAttributs[1].location = 1; // triangle.vert : layout (location = 1)
-    vertexInputAttributs[1].format   = VK_FORMAT_R32G32B32_SFLOAT;
-    vertexInputAttributs[1].offset   = 12; // sizeof(float) * 3
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &vertexInputBinding;
-    vertexInputInfo.vertexAttributeDescriptionCount = 2;
-    vertexInputInfo.pVertexAttributeDescriptions = vertexInputAttributs.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    // draws triangle here
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-                                    &pipelineLayout));
-    std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT,
-                                                        VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicStateCI{};
-    dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
-    dynamicStateCI.dynamicStateCount =
-        static_cast<uint32_t>(dynamicStateEnables.size());
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicStateCI;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                        nullptr, &graphicsPipeline));
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    // compiles in the background, see resolvePipeline().
+    pipelineState = getPipelineState();
+    pipelineHandle = pipelineRegistry.request(pipelineState);
+    graphicsPipeline = VK_NULL_HANDLE;
+
+    return;
+}
+
+/*
+ * Picks up the pipeline once its background compile is done. Until then
+ * graphicsPipeline is VK_NULL_HANDLE and the draws are skipped, so the
+ * cached recordings are redone when it changes. The compile job invalidates
+ * the app when it finishes, see initVulkan().
+ */
+void VKColorApp::resolvePipeline()
+{
+    VkPipeline pipeline = pipelineRegistry.resolve(pipelineHandle);
+    if (pipeline != graphicsPipeline) {
+        graphicsPipeline = pipeline;
+        commandBufferCache.invalidate();
+    }
+
+    return;
+}
+
+/*
+ * The swapchain format can change with the surface, the render pass and
+ * every pipeline created for it are not compatible with the new one.
+ */
+void VKColorApp::recreateRenderPass()
+{
+    uint64_t retireValue = frameSync.getSubmittedValue() + framesInFlight;
+
+    pipelineRegistry.retire(renderPass, deletionQueue, retireValue);
+    VkDevice device = this->device;
+    VkRenderPass oldRenderPass = renderPass;
+    deletionQueue.push(retireValue, [device, oldRenderPass]() {
+        vkDestroyRenderPass(device, oldRenderPass, VULKAN_CPU_ALLOCATOR);
+    });
+
+    createRenderPass();
+    pipelineState = getPipelineState();
+    pipelineHandle = pipelineRegistry.request(pipelineState);
+    graphicsPipeline = VK_NULL_HANDLE;
+
+    return;
+}
+
+VKPipelineState VKColorApp::getPipelineState()
+{
+    VKPipelineState state;
+    state.vertexShader = enablePushConstantTransforms ? pushVertexShader : vertexShader;
+    state.fragmentShader = fragmentShader;
+    state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    state.specialization.setInt(SPEC_CONSTANT_COLOR_MODE, static_cast<int32_t>(colorMode));
+    if (colorMode == VKColorMode::Constant) {
+        state.specialization.setFloat(SPEC_CONSTANT_COLOR_R, constantColor.r);
+        state.specialization.setFloat(SPEC_CONSTANT_COLOR_G, constantColor.g);
+        state.specialization.setFloat(SPEC_CONSTANT_COLOR_B, constantColor.b);
+    }
+    state.depthTest = enableDepthBuffer;
+    state.depthWrite = enableDepthBuffer;
+    state.layout = pipelineLayout;
+    state.renderPass = renderPass;
+    // shares the pipeline with the other topologies when supported.
+    state.dynamicTopology = dynamicState.isEnabled();
+
+    return state;
 }
 
 void VKColorApp::createFramebuffers() {
+    // the depth image follows the swapchain extent, it is recreated here
+    // and destroyed in cleanupSwapChain().
+    if (enableDepthBuffer) {
+        depthAttachment.create(swapChainExtent);
+    }
+
     swapChainFramebuffers.resize(swapChainImageViews.size());
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {swapChainImageViews[i]};
+        std::vector<VkImageView> attachments = {swapChainImageViews[i]};
+        if (enableDepthBuffer) {
+            attachments.push_back(depthAttachment.getView());
+        }
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
         framebufferInfo.width = swapChainExtent.width;
         framebufferInfo.height = swapChainExtent.height;
         framebufferInfo.layers = 1;
 
-        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, nullptr,
+        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, VULKAN_CPU_ALLOCATOR,
                                     &swapChainFramebuffers[i]));
     }
 }
@@ -644,21 +633,22 @@ void VKColorApp::createCommandPool()
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR, &commandPool));
 
     return;
 }
 
 void VKColorApp::createCommandBuffer()
 {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = commandBuffers.size();
-
-    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()));
+    // command buffers are allocated on first use, per frame slot and image.
+    commandBufferCache.init(device, commandPool, MAX_FRAMES_IN_FLIGHT);
+
+    parallelRecorder.init(device, findQueueFamilies(physicalDevice).graphicsFamily.value(),
+                          &jobSystem, MAX_FRAMES_IN_FLIGHT);
+    if (enableBenchmarks) {
+        benchmarkParallelRecording();
+        benchmarkTransforms();
+    }
 
     return;
 }
@@ -671,7 +661,7 @@ void VKColorApp::createCommandBuffer()
  */
 void VKColorApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                            VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                           VkDeviceMemory &bufferMemory)
+                           VKAllocation &bufferAllocation)
 {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -679,20 +669,17 @@ void VKColorApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    VK_CHECK(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer));
+    VK_CHECK(vkCreateBuffer(device, &bufferInfo, VULKAN_CPU_ALLOCATOR, &buffer));
 
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex =
+    uint32_t memoryTypeIndex =
         findMemoryType(memRequirements.memoryTypeBits, properties);
+    VK_CHECK(memoryAllocator.allocate(memRequirements, memoryTypeIndex, bufferAllocation));
 
-    VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory));
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    VK_CHECK(vkBindBufferMemory(device, buffer, bufferAllocation.memory,
+                                bufferAllocation.offset));
 }
 
 /*
@@ -720,65 +707,57 @@ uint32_t VKColorApp::findMemoryType(uint32_t typeFilter,
 
 void VKColorApp::createUniformBuffers()
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    // one region per frame in flight, each big enough for the uniform data
+    // of many objects.
+    VkDeviceSize bytesPerFrame = 64 * 1024;
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    uniformBuffers[i], uniformBuffersMemory[i]);
-    }
+    uniformRingBuffer.init(physicalDevice, device, &memoryAllocator,
+                           bytesPerFrame, MAX_FRAMES_IN_FLIGHT);
 }
 
 void VKColorApp::createDescriptorPool()
 {
     VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = 1;
     poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = 1;
 
-    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR, &descriptorPool));
 }
 
 void VKColorApp::createDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-                                                descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
-
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()));
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkWriteDescriptorSet descriptorWrite{};
-        // Uniform buffer
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = descriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
-
-        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-    }
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+
+    // a single descriptor set serves every frame, the frame's slice of the
+    // uniform ring buffer is selected with a dynamic offset at bind time.
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformRingBuffer.getBuffer();
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    VkWriteDescriptorSet descriptorWrite{};
+    // Uniform buffer
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 void VKColorApp::fillVertexData()
@@ -805,195 +784,225 @@ void VKColorApp::fillVertexData()
     indices = {0, 1, 2, 2, 1, 3};
 }
 
+/*
+ * Geometry pools are written on the transfer queue and read on the graphics
+ * queue, they are shared by both families.
+ */
+std::vector<uint32_t> VKColorApp::getMeshQueueFamilies()
+{
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    std::set<uint32_t> uniqueQueueFamilies = {queueFamilyIndices.graphicsFamily.value(),
+                                              queueFamilyIndices.transferFamily.value()};
+
+    return std::vector<uint32_t>(uniqueQueueFamilies.begin(), uniqueQueueFamilies.end());
+}
+
 void VKColorApp::createMeshBuffers()
 {
-    indicesCount = (uint32_t)indices.size();
-
-    // temp vertex buffer
-    VertexBuffer tempVertexBuffer;
-    // temp index buffer
-    IndexBuffer tempIndexBuffer;
-
-    void *dataPtr = nullptr;
-    VkMemoryRequirements memReqInfo;
-    VkMemoryAllocateInfo memAllocInfo;
-    ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
-
-    // create temp vertex buffer
-    VkBufferCreateInfo vertexBufferInfo;
-    ZeroVulkanStruct(vertexBufferInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
-    vertexBufferInfo.size = vertices.size() * sizeof(Vertex);
-    vertexBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    VK_CHECK(vkCreateBuffer(device, &vertexBufferInfo, VULKAN_CPU_ALLOCATOR, &tempVertexBuffer.buffer));
-
-    // get vertex buffer memory requirements
-    vkGetBufferMemoryRequirements(device, tempVertexBuffer.buffer, &memReqInfo);
-
-    // allocate temp vertex buffer memory
-    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    memAllocInfo.allocationSize = memReqInfo.size;
-    memAllocInfo.memoryTypeIndex = findMemoryType(memReqInfo.memoryTypeBits, properties);
-    VK_CHECK(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &tempVertexBuffer.memory));
-    // attach vertex memory to temp vertex buffer
-    VK_CHECK(vkBindBufferMemory(device, tempVertexBuffer.buffer, tempVertexBuffer.memory, 0));
-    // mapping dataPtr pointer (vertices) to temp vertex buffer memory
-    VK_CHECK(vkMapMemory(device, tempVertexBuffer.memory, 0, memAllocInfo.allocationSize, 0, &dataPtr));
-    std::memcpy(dataPtr, vertices.data(), vertexBufferInfo.size);
-    vkUnmapMemory(device, tempVertexBuffer.memory);
-
-    // local device vertex buffer
-    vertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VK_CHECK(vkCreateBuffer(device, &vertexBufferInfo, VULKAN_CPU_ALLOCATOR, &vertexBuffer.buffer));
-    vkGetBufferMemoryRequirements(device, vertexBuffer.buffer, &memReqInfo);
-    properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    memAllocInfo.allocationSize  = memReqInfo.size;
-    memAllocInfo.memoryTypeIndex = findMemoryType(memReqInfo.memoryTypeBits, properties);
-    VK_CHECK(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &vertexBuffer.memory));
-    // attach vertex memory to vertex buffer
-    VK_CHECK(vkBindBufferMemory(device, vertexBuffer.buffer, vertexBuffer.memory, 0));
-
-    // index buffer
-    VkBufferCreateInfo indexBufferInfo;
-    ZeroVulkanStruct(indexBufferInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
-    indexBufferInfo.size  = indicesCount * sizeof(uint16_t);
-    indexBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    VK_CHECK(vkCreateBuffer(device, &indexBufferInfo, VULKAN_CPU_ALLOCATOR, &tempIndexBuffer.buffer));
-
-    // get index buffer memory requirements
-    vkGetBufferMemoryRequirements(device, tempIndexBuffer.buffer, &memReqInfo);
-    // allocate temp index buffer memory
-    properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    memAllocInfo.allocationSize = memReqInfo.size;
-    memAllocInfo.memoryTypeIndex = findMemoryType(memReqInfo.memoryTypeBits, properties);
-    VK_CHECK(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &tempIndexBuffer.memory));
-    // attach index buffer memory to temp index buffer
-    VK_CHECK(vkBindBufferMemory(device, tempIndexBuffer.buffer, tempIndexBuffer.memory, 0));
-    // mapping dataPtr pointer (indices) to temp index buffer memory
-    VK_CHECK(vkMapMemory(device, tempIndexBuffer.memory, 0, memAllocInfo.allocationSize, 0, &dataPtr));
-    std::memcpy(dataPtr, indices.data(), indexBufferInfo.size);
-    vkUnmapMemory(device, tempIndexBuffer.memory);
-
-    // local device index buffer
-    indexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VK_CHECK(vkCreateBuffer(device, &indexBufferInfo, VULKAN_CPU_ALLOCATOR, &indicesBuffer.buffer));
-    vkGetBufferMemoryRequirements(device, indicesBuffer.buffer, &memReqInfo);
-    properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    memAllocInfo.allocationSize  = memReqInfo.size;
-    memAllocInfo.memoryTypeIndex = findMemoryType(memReqInfo.memoryTypeBits, properties);
-    VK_CHECK(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &indicesBuffer.memory));
-    // attach index buffer memory to index buffer
-    VK_CHECK(vkBindBufferMemory(device, indicesBuffer.buffer, indicesBuffer.memory, 0));
-    
-    VkCommandBuffer xferCmdBuffer;
-    VkCommandBufferAllocateInfo xferCmdBufferInfo;
-    ZeroVulkanStruct(xferCmdBufferInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO);
-    // better to use transfer queue for data transfer op
-    // here graphics queue is used for simplification.
-    // it seems error is here, driver related.
-    xferCmdBufferInfo.commandPool = commandPool;
-    xferCmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    xferCmdBufferInfo.commandBufferCount = 1;
-    VK_CHECK(vkAllocateCommandBuffers(device, &xferCmdBufferInfo, &xferCmdBuffer));
-
-    // Begin recording commands
-    VkCommandBufferBeginInfo cmdBufferBeginInfo;
-    ZeroVulkanStruct(cmdBufferBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
-    VK_CHECK(vkBeginCommandBuffer(xferCmdBuffer, &cmdBufferBeginInfo));
-
-    VkBufferCopy copyRegion = {};
-    copyRegion.size = vertices.size() * sizeof(Vertex);
-    vkCmdCopyBuffer(xferCmdBuffer, tempVertexBuffer.buffer, vertexBuffer.buffer, 1, &copyRegion);
-
-    copyRegion.size = indices.size() * sizeof(uint16_t);
-    vkCmdCopyBuffer(xferCmdBuffer, tempIndexBuffer.buffer, indicesBuffer.buffer, 1, &copyRegion);
-
-    // End recording commands
-    VK_CHECK(vkEndCommandBuffer(xferCmdBuffer));
-
-    // submit commands, and wait...
-    VkSubmitInfo submitInfo;
-    ZeroVulkanStruct(submitInfo, VK_STRUCTURE_TYPE_SUBMIT_INFO);
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers    = &xferCmdBuffer;
+    std::vector<uint32_t> sharedFamilies = getMeshQueueFamilies();
+
+    // sized for the meshes the app draws, addMesh() fails past that.
+    geometryPool.init(device, &memoryAllocator, &uploadManager, sharedFamilies,
+                      sizeof(Vertex), (uint32_t)vertices.size(), (uint32_t)indices.size());
+    meshHandle = geometryPool.addMesh(vertices.data(), (uint32_t)vertices.size(),
+                                      indices.data(), (uint32_t)indices.size());
+    if (meshHandle == INVALID_MESH_HANDLE) {
+        LOGE("failed to add the mesh to the geometry pool, nothing will be drawn");
+    }
 
-    VkFenceCreateInfo fenceInfo;
-    ZeroVulkanStruct(fenceInfo, VK_STRUCTURE_TYPE_FENCE_CREATE_INFO);
-    fenceInfo.flags = 0;
+    // staged copies go into one batch, nothing waits here. With zero-copy the
+    // batch is empty and the returned token is already complete.
+    meshUploadToken = uploadManager.flush();
 
-    VkFence fence = VK_NULL_HANDLE;
-    VK_CHECK(vkCreateFence(device, &fenceInfo, VULKAN_CPU_ALLOCATOR, &fence));
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence));
-    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, MAX_int64));
+    memoryAllocator.logStats();
 
-    vkDestroyFence(device, fence, VULKAN_CPU_ALLOCATOR);
-    vkFreeCommandBuffers(device, commandPool, 1, &xferCmdBuffer);
+    if (enableBenchmarks) {
+        benchmarkMeshUploads();
+    }
+}
 
-    vkDestroyBuffer(device, tempVertexBuffer.buffer, VULKAN_CPU_ALLOCATOR);
-    vkFreeMemory(device, tempVertexBuffer.memory, VULKAN_CPU_ALLOCATOR);
-    vkDestroyBuffer(device, tempIndexBuffer.buffer, VULKAN_CPU_ALLOCATOR);
-    vkFreeMemory(device, tempIndexBuffer.memory, VULKAN_CPU_ALLOCATOR);
+/*
+ * Times the creation of a geometry pool holding a 4MB mesh, 3MB of vertices
+ * and 1MB of indices, through the staging path and, on unified memory
+ * devices, through the zero-copy path. The staging time includes waiting for
+ * the transfer to complete, as that is when the data becomes usable.
+ */
+void VKColorApp::benchmarkMeshUploads()
+{
+    const uint32_t vertexCount = 3 * 1024 * 1024 / sizeof(Vertex);
+    const uint32_t indexCount = 1024 * 1024 / sizeof(uint16_t);
+    const int iterations = 8;
+    const double megabytes = (double)(vertexCount * sizeof(Vertex) +
+                                      indexCount * sizeof(uint16_t)) / (1024.0 * 1024.0);
+    std::vector<uint8_t> vertexData(vertexCount * sizeof(Vertex), 0x5a);
+    std::vector<uint16_t> indexData(indexCount, 0);
+
+    std::vector<uint32_t> sharedFamilies = getMeshQueueFamilies();
+
+    double timeMs[2] = {0.0, 0.0};
+    bool zeroCopyAvailable = false;
+    for (int path = 0; path < 2; path++) {
+        bool allowZeroCopy = path == 1;
+        for (int i = 0; i < iterations; i++) {
+            VKGeometryPool pool;
+            auto start = std::chrono::high_resolution_clock::now();
+            pool.init(device, &memoryAllocator, &uploadManager, sharedFamilies,
+                      sizeof(Vertex), vertexCount, indexCount, allowZeroCopy);
+            VKMeshHandle handle = pool.addMesh(vertexData.data(), vertexCount,
+                                               indexData.data(), indexCount);
+            uploadManager.wait(uploadManager.flush());
+            auto end = std::chrono::high_resolution_clock::now();
+
+            timeMs[path] += std::chrono::duration<double, std::milli>(end - start).count();
+            zeroCopyAvailable = zeroCopyAvailable || pool.isZeroCopy();
+
+            if (handle != INVALID_MESH_HANDLE) {
+                pool.removeMesh(handle);
+            }
+            pool.destroy();
+        }
+    }
+
+    double stagingMsPerMB = timeMs[0] / (iterations * megabytes);
+    LOGI("benchmark: staging upload %.3f ms/MB", stagingMsPerMB);
+    if (!zeroCopyAvailable) {
+        LOGI("benchmark: no DEVICE_LOCAL | HOST_VISIBLE memory, zero-copy not available");
+        return;
+    }
+
+    double zeroCopyMsPerMB = timeMs[1] / (iterations * megabytes);
+    LOGI("benchmark: zero-copy upload %.3f ms/MB, %.3f ms/MB saved",
+         zeroCopyMsPerMB, stagingMsPerMB - zeroCopyMsPerMB);
+
+    return;
 }
 
 void VKColorApp::destroyMeshBuffers()
 {
-    vkDestroyBuffer(device, vertexBuffer.buffer, VULKAN_CPU_ALLOCATOR);
-    vkFreeMemory(device, vertexBuffer.memory, VULKAN_CPU_ALLOCATOR);
-    vkDestroyBuffer(device, indicesBuffer.buffer, VULKAN_CPU_ALLOCATOR);
-    vkFreeMemory(device, indicesBuffer.memory, VULKAN_CPU_ALLOCATOR);
+    if (meshHandle != INVALID_MESH_HANDLE) {
+        geometryPool.removeMesh(meshHandle);
+        meshHandle = INVALID_MESH_HANDLE;
+    }
+    geometryPool.destroy();
 }
 
 void VKColorApp::createSyncObjects()
 {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VULKAN_CPU_ALLOCATOR,
                                 &imageAvailableSemaphores[i]));
 
-        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VULKAN_CPU_ALLOCATOR,
                                 &renderFinishedSemaphores[i]));
-
-        VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]));
     }
+    frameSync.init(device, timelineSemaphoreSupported, MAX_FRAMES_IN_FLIGHT);
+    frameLatency.reset(framesInFlight);
 
     return;
 }
 
+/*
+ * Runs the init steps as a VKInitGraph, see vk_init_graph.h. Each node lists
+ * the nodes it reads the results of.
+ */
 void VKColorApp::initVulkan()
 {
-    createInstance();
-    VKBaseApp::createSurface();
-    pickPhysicalDevice();
-    createLogicalDevicesAndQueue();
-    VKBaseApp::setupDebugMessenger();
-    establishDisplaySizeIdentity();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets(); 
-    createGraphicsPipeline();
-    createFramebuffers();
-    createCommandPool();
-    fillVertexData();
-    createMeshBuffers();
-    createCommandBuffer();
-    createSyncObjects();
+    initJobSystem();
+    // before the graph, the device node validates what it loads.
+    shaderCache.init(assetManager, getShaderIdentifierPath());
+
+    VKInitGraph graph;
+    VKInitNode shaders = graph.add("prefetch shaders", [this] {
+        shaderCache.prefetch({vertexShader, pushVertexShader, fragmentShader}, jobSystem);
+    });
+    VKInitNode instance = graph.add("instance", [this] {
+        createInstance();
+    });
+    graph.add("debug messenger", [this] {
+        VKBaseApp::setupDebugMessenger();
+    }, {instance});
+    VKInitNode surface = graph.add("surface", [this] {
+        VKBaseApp::createSurface();
+    }, {instance});
+    VKInitNode logicalDevice = graph.add("device", [this] {
+        pickPhysicalDevice();
+        createLogicalDevicesAndQueue();
+    }, {surface});
+    VKInitNode allocators = graph.add("allocators", [this] {
+        memoryAllocator.init(physicalDevice, device);
+        uploadManager.init(device, &memoryAllocator,
+                           findQueueFamilies(physicalDevice).transferFamily.value(),
+                           transferQueue, timelineSemaphoreSupported);
+    }, {logicalDevice});
+    VKInitNode swapchain = graph.add("swapchain", [this] {
+        establishDisplaySizeIdentity();
+        createSwapChain();
+        createImageViews();
+    }, {logicalDevice});
+    VKInitNode renderPassNode = graph.add("render pass", [this] {
+        createRenderPass();
+    }, {allocators, swapchain});
+    VKInitNode descriptors = graph.add("descriptors", [this] {
+        layoutCache.init(device);
+        createDescriptorSetLayout();
+        createUniformBuffers();
+        createDescriptorPool();
+        createDescriptorSets();
+    }, {shaders, allocators});
+    VKInitNode cache = graph.add("pipeline cache", [this] {
+        pipelineCache.init(physicalDevice, device, getPipelineCachePath());
+        // a finished compile changes what the next frame draws.
+        pipelineRegistry.init(device, &pipelineCache, &shaderCache, &jobSystem,
+                              &dynamicState, [this] { invalidateAsync(); });
+    }, {logicalDevice});
+    VKInitNode pipeline = graph.add("pipeline", [this] {
+        createGraphicsPipeline();
+    }, {shaders, cache, renderPassNode, descriptors});
+    VKInitNode framebuffers = graph.add("framebuffers", [this] {
+        createFramebuffers();
+    }, {renderPassNode});
+    VKInitNode meshes = graph.add("mesh buffers", [this] {
+        fillVertexData();
+        createMeshBuffers();
+    }, {allocators});
+    graph.add("command buffers", [this] {
+        createCommandPool();
+        createCommandBuffer();
+    }, {pipeline, framebuffers, meshes});
+    graph.add("sync objects", [this] {
+        createSyncObjects();
+    }, {logicalDevice});
+
+    graph.run(jobSystem);
+    graph.logReport();
+    VKHostAllocator::get().logStats("init");
 
     initialized = true;
     return;
 }
 
+/*
+ * Resources of all MAX_FRAMES_IN_FLIGHT frames always exist, only the number
+ * of slots render() cycles through changes. Once the device is idle every
+ * submitted frame value has completed, so the slots can be renumbered from 0.
+ */
+void VKColorApp::applyFramesInFlight()
+{
+    vkDeviceWaitIdle(device);
+    LOGI("frames in flight %u -> %u", framesInFlight, requestedFramesInFlight);
+    framesInFlight = requestedFramesInFlight;
+    currentFrame = 0;
+    frameLatency.reset(framesInFlight);
+
+    return;
+}
+
 void VKColorApp::onOrientationChange()
 {
     recreateSwapChain();
@@ -1008,8 +1017,6 @@ void VKColorApp::recordCommandBuffer(VkCommandBuffer commandBuffer,
     beginInfo.flags = 0;
     beginInfo.pInheritanceInfo = nullptr;
 
-    VkDeviceSize offsets[1] = { 0 };
-
     VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
     VkRenderPassBeginInfo renderPassInfo{};
@@ -1019,6 +1026,53 @@ void VKColorApp::recordCommandBuffer(VkCommandBuffer commandBuffer,
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = swapChainExtent;
 
+    static float black;
+    black = 0.0f;
+    VkClearValue clearValues[2];
+    clearValues[0].color = {{black, black, black, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassInfo.clearValueCount = enableDepthBuffer ? 2 : 1;
+    renderPassInfo.pClearValues = clearValues;
+
+    if (!enableParallelRecording || !VKParallelRecorder::isWorthIt(sceneDrawCount)) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                            VK_SUBPASS_CONTENTS_INLINE);
+        recordDraws(commandBuffer, 0, sceneDrawCount);
+        vkCmdEndRenderPass(commandBuffer);
+        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+        return;
+    }
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                        VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    parallelRecorder.record(
+        commandBuffer, currentFrame, imageIndex, inheritanceInfo, sceneDrawCount,
+        [this](VkCommandBuffer secondary, uint32_t firstDraw, uint32_t drawCount) {
+            recordDraws(secondary, firstDraw, drawCount);
+        });
+
+    vkCmdEndRenderPass(commandBuffer);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    return;
+}
+
+/*
+ * Records the draws [firstDraw, firstDraw + drawCount) of the scene, with
+ * all the state they need: with parallel recording this runs on several
+ * threads at once, each into its own secondary command buffer, which
+ * inherits no dynamic state.
+ */
+void VKColorApp::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                             uint32_t drawCount)
+{
     VkViewport viewport{};
     viewport.width = (float)swapChainExtent.width;
     viewport.height = (float)swapChainExtent.height;
@@ -1030,51 +1084,258 @@ void VKColorApp::recordCommandBuffer(VkCommandBuffer commandBuffer,
     scissor.extent = swapChainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    static float black;
-    black = 0.0f;
-    VkClearValue clearColor = {{{black, black, black, 1.0f}}};
+    // still compiling or no mesh, only the clear is recorded.
+    if (graphicsPipeline == VK_NULL_HANDLE || meshHandle == INVALID_MESH_HANDLE) {
+        return;
+    }
 
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                        VK_SUBPASS_CONTENTS_INLINE);
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                         graphicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descriptorSets[currentFrame],
-                            0, nullptr);
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indicesBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-    // vkCmdDraw(commandBuffer, 6, 1, 0, 0);
-    vkCmdDrawIndexed(commandBuffer, indicesCount, 1, 0, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
-    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+    if (pipelineState.dynamicTopology) {
+        dynamicState.record(commandBuffer, pipelineState.topology, pipelineState.cullMode,
+                            pipelineState.frontFace, pipelineState.lineWidth);
+    }
+    // the push constant shaders have no descriptor set.
+    if (!enablePushConstantTransforms) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelineLayout, 0, 1, &descriptorSet,
+                                1, &frameUniforms.offset);
+    }
+    geometryPool.bind(commandBuffer);
+    // the sample has a single mesh, sceneDrawCount > 1 only stresses recording.
+    for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+        // one push per object, the sample's objects all share the frame's MVP.
+        if (enablePushConstantTransforms) {
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+                               0, sizeof(frameTransform), &frameTransform);
+        }
+        geometryPool.draw(commandBuffer, meshHandle);
+    }
+
+    return;
+}
+
+/*
+ * Times the recording of a render pass with BENCHMARK_DRAWS draws in 1, 2,
+ * 4, ... shares on the job system. Nothing is submitted, only the CPU side
+ * is measured.
+ */
+void VKColorApp::benchmarkParallelRecording()
+{
+    const uint32_t BENCHMARK_DRAWS = 10000;
+    const int iterations = 16;
+
+    // without the pipeline the draws would be skipped.
+    pipelineRegistry.wait(pipelineHandle);
+    resolvePipeline();
+
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[0];
+    renderPassInfo.renderArea.extent = swapChainExtent;
+    VkClearValue clearValues[2] = {};
+    renderPassInfo.clearValueCount = enableDepthBuffer ? 2 : 1;
+    renderPassInfo.pClearValues = clearValues;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = swapChainFramebuffers[0];
+
+    VKParallelRecorder::RecordFunction recordFunction =
+        [this](VkCommandBuffer secondary, uint32_t firstDraw, uint32_t drawCount) {
+            recordDraws(secondary, firstDraw, drawCount);
+        };
+
+    double singleThreadMs = 0.0;
+    for (uint32_t threads = 1; threads <= parallelRecorder.getShareCount(); threads *= 2) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            parallelRecorder.record(commandBuffer, 0, 0, inheritanceInfo, BENCHMARK_DRAWS,
+                                    recordFunction, threads);
+            vkCmdEndRenderPass(commandBuffer);
+            VK_CHECK(vkEndCommandBuffer(commandBuffer));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        if (threads == 1) {
+            singleThreadMs = ms;
+        }
+        LOGI("benchmark: recording %u draws in %u shares %.3f ms, %.2fx",
+             BENCHMARK_DRAWS, threads, ms, singleThreadMs / ms);
+    }
+
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    // the secondaries of slot 0 / image 0 now hold the benchmark draws.
+    commandBufferCache.invalidate();
+
+    return;
+}
+
+/*
+ * Times recording BENCHMARK_DRAWS draws that each get their own MVP, once
+ * from a uniform buffer slot (write the slot, bind the set with its dynamic
+ * offset) with vertexShader and once with vkCmdPushConstants with
+ * pushVertexShader. Nothing is submitted, only the CPU side is measured.
+ */
+void VKColorApp::benchmarkTransforms()
+{
+    const uint32_t BENCHMARK_DRAWS = 10000;
+    // the draws cycle through as many slots as fit in a frame's region.
+    const uint32_t UNIFORM_SLOTS = 128;
+    const int iterations = 16;
+    if (meshHandle == INVALID_MESH_HANDLE) {
+        return;
+    }
+
+    VKPipelineState uniformState = getPipelineState();
+    uniformState.vertexShader = vertexShader;
+    uniformState.layout = uniformPipelineLayout;
+    VKPipelineState pushState = uniformState;
+    pushState.vertexShader = pushVertexShader;
+    pushState.layout = pushPipelineLayout;
+    VkPipeline uniformPipeline = pipelineRegistry.get(uniformState);
+    VkPipeline pushPipeline = pipelineRegistry.get(pushState);
+
+    // runs before the first frame, frame 0's region is free.
+    uniformRingBuffer.beginFrame(0);
+    std::vector<VKUniformSlice> slots(UNIFORM_SLOTS);
+    for (VKUniformSlice &slot : slots) {
+        slot = uniformRingBuffer.allocate(sizeof(UniformBufferObject));
+    }
+    PushConstantObject transform{};
+    transform.mvp = glm::mat4(1.0f);
+
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[0];
+    renderPassInfo.renderArea.extent = swapChainExtent;
+    VkClearValue clearValues[2] = {};
+    renderPassInfo.clearValueCount = enableDepthBuffer ? 2 : 1;
+    renderPassInfo.pClearValues = clearValues;
+
+    double ms[2] = {};
+    for (int push = 0; push < 2; push++) {
+        const VKPipelineState &state = push ? pushState : uniformState;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              push ? pushPipeline : uniformPipeline);
+            if (state.dynamicTopology) {
+                dynamicState.record(commandBuffer, state.topology, state.cullMode,
+                                    state.frontFace, state.lineWidth);
+            }
+            geometryPool.bind(commandBuffer);
+            for (uint32_t draw = 0; draw < BENCHMARK_DRAWS; draw++) {
+                if (push) {
+                    vkCmdPushConstants(commandBuffer, pushPipelineLayout,
+                                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform),
+                                       &transform);
+                } else {
+                    const VKUniformSlice &slot = slots[draw % UNIFORM_SLOTS];
+                    memcpy(slot.data, &transform, sizeof(transform));
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                            uniformPipelineLayout, 0, 1, &descriptorSet,
+                                            1, &slot.offset);
+                }
+                geometryPool.draw(commandBuffer, meshHandle);
+            }
+            vkCmdEndRenderPass(commandBuffer);
+            VK_CHECK(vkEndCommandBuffer(commandBuffer));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        ms[push] = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+    }
+    LOGI("benchmark: %u draws with per-draw MVP, uniform buffer %.3f ms, "
+         "push constants %.3f ms, %.2fx",
+         BENCHMARK_DRAWS, ms[0], ms[1], ms[0] / ms[1]);
+
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 
     return;
 }
 
 void VKColorApp::updateUniformBuffer(uint32_t currentImage) 
 {
-    SwapChainSupportDetails swapChainSupport =
-        querySwapChainSupport(physicalDevice);
+    // only the capabilities are needed here, querySwapChainSupport() would
+    // also enumerate formats and present modes into vectors every frame.
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
     UniformBufferObject ubo{};
-    getGlmPrerotationMatrix(swapChainSupport.capabilities, pretransformFlag,
+    getGlmPrerotationMatrix(capabilities, pretransformFlag,
                         ubo.mvp, 1.0f, 1.0f, 1.0f);
-    void *data;
-    vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0,
-                &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+    if (enablePushConstantTransforms) {
+        // pushed by recordDraws(), no uniform slot.
+        frameTransform.mvp = ubo.mvp;
+        return;
+    }
+    // the GPU is done with this frame's region, see render().
+    uniformRingBuffer.beginFrame(currentImage);
+    frameUniforms = uniformRingBuffer.allocate(sizeof(ubo));
+    memcpy(frameUniforms.data, &ubo, sizeof(ubo));
+}
+
+uint64_t VKColorApp::getRecordingKey() const
+{
+    // the dynamic uniform offset, or the pushed MVP, is recorded as a value.
+    if (enablePushConstantTransforms) {
+        return HashFNV1a(&frameTransform, sizeof(frameTransform));
+    }
+
+    return frameUniforms.offset;
 }
 
 void VKColorApp::render()
 {
+    swapchainHitch.onFrame();
+    dirty = false;
+
     if (orientationChanged) {
         onOrientationChange();
     }
 
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE,
-                    UINT64_MAX);
+    if (framesInFlight != requestedFramesInFlight) {
+        applyFramesInFlight();
+    }
+
+    if (presentPolicy.getGoal() != requestedPresentGoal) {
+        recreateSwapChain();
+    }
+
+    frameLatency.poll(frameSync.getCompletedValue());
+    frameSync.waitForSlot(currentFrame);
+    frameLatency.onComplete(currentFrame);
+    deletionQueue.collect(frameSync.getCompletedValue());
+    presentPolicy.beginFrame();
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(
         device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
@@ -1087,10 +1348,19 @@ void VKColorApp::render()
             result == VK_SUBOPTIMAL_KHR);  // failed to acquire swap chain image
     updateUniformBuffer(currentFrame);
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+    // no-op once the mesh upload has completed.
+    uploadManager.wait(meshUploadToken);
 
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    resolvePipeline();
+    if (!enableCommandBufferCache) {
+        commandBufferCache.invalidate();
+    }
+    bool upToDate = false;
+    VkCommandBuffer commandBuffer = commandBufferCache.get(
+        currentFrame, imageIndex, getRecordingKey(), upToDate);
+    if (!upToDate) {
+        recordCommandBuffer(commandBuffer, imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1102,13 +1372,13 @@ void VKColorApp::render()
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo,
-                            inFlightFences[currentFrame]));
+    uint64_t frameValue = frameSync.submit(graphicsQueue, currentFrame, submitInfo);
+    frameLatency.onSubmit(currentFrame, frameValue);
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1123,6 +1393,7 @@ void VKColorApp::render()
     presentInfo.pResults = nullptr;
 
     result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    presentPolicy.endFrame();
     if (result == VK_SUBOPTIMAL_KHR) {
         orientationChanged = true;
     } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -1130,7 +1401,7 @@ void VKColorApp::render()
     } else {
         assert(result == VK_SUCCESS);  // failed to present swap chain image!
     }
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % framesInFlight;
 
     return;
 }
@@ -1138,28 +1409,34 @@ void VKColorApp::render()
 void VKColorApp::cleanup()
 {
     vkDeviceWaitIdle(device);
+    deletionQueue.flush();
+    presentPolicy.logStats();
     cleanupSwapChain();
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, VULKAN_CPU_ALLOCATOR);
 
-    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-    }
+    uniformRingBuffer.destroy();
 
     destroyMeshBuffers();
+    uploadManager.destroy();
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], VULKAN_CPU_ALLOCATOR);
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], VULKAN_CPU_ALLOCATOR);
     }
-    vkDestroyCommandPool(device, commandPool, nullptr);
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
-    vkDestroyDevice(device, nullptr);
+    frameSync.destroy();
+    commandBufferCache.logStats();
+    commandBufferCache.destroy();
+    parallelRecorder.destroy();
+    vkDestroyCommandPool(device, commandPool, VULKAN_CPU_ALLOCATOR);
+    pipelineRegistry.logStats();
+    pipelineRegistry.destroy();
+    layoutCache.logStats();
+    layoutCache.destroy();
+    shaderCache.destroy();
+    pipelineCache.destroy();
+    vkDestroyRenderPass(device, renderPass, VULKAN_CPU_ALLOCATOR);
+    memoryAllocator.destroy();
+    vkDestroyDevice(device, VULKAN_CPU_ALLOCATOR);
     VKBaseApp::cleanup();
 
     return;
@@ -1168,25 +1445,77 @@ void VKColorApp::cleanup()
 void VKColorApp::cleanupSwapChain()
 {
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-        vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+        vkDestroyFramebuffer(device, swapChainFramebuffers[i], VULKAN_CPU_ALLOCATOR);
     }
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+        vkDestroyImageView(device, swapChainImageViews[i], VULKAN_CPU_ALLOCATOR);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    swapChainFramebuffers.clear();
+    swapChainImageViews.clear();
+
+    depthAttachment.destroy();
+
+    vkDestroySwapchainKHR(device, swapChain, VULKAN_CPU_ALLOCATOR);
+    swapChain = VK_NULL_HANDLE;
+
+    return;
+}
+
+/*
+ * Hands the swapchain and everything built on it to the deletion queue.
+ * Frames submitted so far still render into its framebuffers and the
+ * presentation engine may still hold its images, which is only known to be
+ * over once framesInFlight more frames have completed.
+ */
+void VKColorApp::retireSwapChain()
+{
+    uint64_t retireValue = frameSync.getSubmittedValue() + framesInFlight;
+
+    VkDevice device = this->device;
+    VkSwapchainKHR oldSwapChain = swapChain;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkImageView> imageViews;
+    framebuffers.swap(swapChainFramebuffers);
+    imageViews.swap(swapChainImageViews);
+    deletionQueue.push(retireValue, [device, oldSwapChain, framebuffers, imageViews]() {
+        for (VkFramebuffer framebuffer : framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, VULKAN_CPU_ALLOCATOR);
+        }
+        for (VkImageView imageView : imageViews) {
+            vkDestroyImageView(device, imageView, VULKAN_CPU_ALLOCATOR);
+        }
+        vkDestroySwapchainKHR(device, oldSwapChain, VULKAN_CPU_ALLOCATOR);
+    });
+    depthAttachment.retire(deletionQueue, retireValue);
 
     return;
 }
 
 void VKColorApp::recreateSwapChain()
 {
-    vkDeviceWaitIdle(device);
-    cleanupSwapChain();
+    if (enableDeferredSwapchainRecreation) {
+        // swapChain stays alive until createSwapChain() passed it as oldSwapchain.
+        retireSwapChain();
+        swapchainHitch.begin("deferred swapchain recreation");
+    } else {
+        vkDeviceWaitIdle(device);
+        cleanupSwapChain();
+        swapchainHitch.begin("idle swapchain recreation");
+    }
+    VkFormat oldFormat = swapChainImageFormat;
     createSwapChain();
     createImageViews();
+    if (swapChainImageFormat != oldFormat) {
+        recreateRenderPass();
+    }
     createFramebuffers();
+    VKHostAllocator::get().logStats("swapchain recreation");
+    // the frame that hit the recreation was not presented.
+    invalidate();
+    // the recordings reference the old framebuffers and extent.
+    commandBufferCache.invalidate();
 
     return;
 }
@@ -1195,6 +1524,11 @@ void VKColorApp::reset(ANativeWindow *newWindow, AAssetManager *newManager)
 {
     VKBaseApp::reset(newWindow, newManager);
     if (initialized) {
+        // the new window comes with a new surface, the swapchain of the old
+        // one can't be passed as oldSwapchain.
+        vkDeviceWaitIdle(device);
+        deletionQueue.flush();
+        cleanupSwapChain();
         recreateSwapChain();
     }
 
@@ -20,7 +20,9 @@ class VKColorApp : public VKBaseApp
         void createImageViews();
         void createRenderPass();
         void createDescriptorSetLayout();
-        virtual void createGraphicsPipeline();
+        void createGraphicsPipeline();
+        // the pipeline of the sample, subclasses change topology, shaders etc.
+        virtual VKPipelineState getPipelineState();
         void createFramebuffers();
         void createCommandPool();
         void createCommandBuffer();
@@ -32,20 +34,31 @@ class VKColorApp : public VKBaseApp
         bool isDeviceSuitable(VkPhysicalDevice device);
         bool checkValidationLayerSupport();
 
-        VkShaderModule createShaderModule(const std::vector<uint8_t> &code);
         virtual void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+        virtual void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                                 uint32_t drawCount);
+        void benchmarkParallelRecording();
+        void benchmarkTransforms();
         void recreateSwapChain();
+        void recreateRenderPass();
+        void resolvePipeline();
+        void retireSwapChain();
+        void applyFramesInFlight();
         void onOrientationChange();
         uint32_t findMemoryType(uint32_t typeFilter,
                                 VkMemoryPropertyFlags properties);
         void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                 VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                VkDeviceMemory &bufferMemory);
+                VKAllocation &bufferAllocation);
         void createUniformBuffers();
         void updateUniformBuffer(uint32_t currentImage);
+        // what the recording of this frame bakes in, see VKCommandBufferCache::get().
+        uint64_t getRecordingKey() const;
         void createDescriptorPool();
         void createDescriptorSets();
+        std::vector<uint32_t> getMeshQueueFamilies();
         void createMeshBuffers();
+        void benchmarkMeshUploads();
         virtual void fillVertexData();
         void destroyMeshBuffers();
         void establishDisplaySizeIdentity();
@@ -57,37 +70,70 @@ class VKColorApp : public VKBaseApp
 
         VkQueue graphicsQueue;
         VkQueue presentQueue;
+        VkQueue transferQueue;
 
         VkRenderPass renderPass;
         VkDescriptorSetLayout descriptorSetLayout;
+        // the layouts of the uniform buffer and push constant shaders,
+        // pipelineLayout is the one of the shaders drawn with.
+        VkPipelineLayout uniformPipelineLayout;
+        VkPipelineLayout pushPipelineLayout;
         VkPipelineLayout pipelineLayout;
-        VkPipeline graphicsPipeline;
+        // the state pipelineHandle was requested with, recordDraws() sets
+        // its dynamic part.
+        VKPipelineState pipelineState;
+        // constant once constructed, subclasses set their own. Read by init
+        // graph nodes that run before the render pass or the layouts exist.
+        const char *vertexShader = "shaders/001_shader.vert.spv";
+        // the same with the MVP from push constants, see enablePushConstantTransforms.
+        const char *pushVertexShader = "shaders/001_shader_push.vert.spv";
+        const char *fragmentShader = "shaders/001_shader.frag.spv";
+        VKPipelineHandle pipelineHandle = INVALID_PIPELINE_HANDLE;
+        // pipelineHandle resolved for this frame, VK_NULL_HANDLE while compiling.
+        VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+        // specialization constants of the shaders, see vk_specialization.h.
+        // constantColor is only part of the variant with VKColorMode::Constant.
+        VKColorMode colorMode = VKColorMode::Vertex;
+        glm::vec3 constantColor = glm::vec3(0.67f, 0.1f, 0.2f);
 
         std::vector<Vertex> vertices;
         std::vector<uint16_t> indices;
-        VertexBuffer vertexBuffer;
-        IndexBuffer indicesBuffer;
+        // every mesh of the sample lives in one pooled vertex / index buffer pair.
+        VKGeometryPool geometryPool;
+        VKMeshHandle meshHandle = INVALID_MESH_HANDLE;
 
-        std::vector<VkBuffer> uniformBuffers;
-        std::vector<VkDeviceMemory> uniformBuffersMemory;
+        // mesh data is streamed in on the transfer queue, render() only waits
+        // for meshUploadToken if the copies have not landed yet.
+        VKUploadManager uploadManager;
+        VKUploadToken meshUploadToken = 0;
+
+        // per-frame uniform data lives in one persistently mapped ring buffer,
+        // frameUniforms is this frame's UniformBufferObject inside of it.
+        VKUniformRingBuffer uniformRingBuffer;
+        VKUniformSlice frameUniforms;
+        // the MVP pushed per draw with enablePushConstantTransforms,
+        // frameUniforms is not allocated then.
+        PushConstantObject frameTransform{};
 
         std::vector<VkSemaphore> imageAvailableSemaphores;
         std::vector<VkSemaphore> renderFinishedSemaphores;
-        std::vector<VkFence> inFlightFences;
         VkDescriptorPool descriptorPool;
-        std::vector<VkDescriptorSet> descriptorSets;
+        VkDescriptorSet descriptorSet;
 
-        VkSwapchainKHR swapChain;
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
         std::vector<VkImage> swapChainImages;
         VkFormat swapChainImageFormat;
         VkExtent2D swapChainExtent;
         VkExtent2D displaySizeIdentity;
         std::vector<VkImageView> swapChainImageViews;
         std::vector<VkFramebuffer> swapChainFramebuffers;
+        VKDepthAttachment depthAttachment;
         VkCommandPool commandPool;
-        std::vector<VkCommandBuffer> commandBuffers;
+        VKCommandBufferCache commandBufferCache;
+        // splits the draws of recordCommandBuffer() across threads.
+        VKParallelRecorder parallelRecorder;
+        uint32_t sceneDrawCount = 1;
 
         uint32_t currentFrame = 0;
-        uint32_t indicesCount = 0;
         VkSurfaceTransformFlagBitsKHR pretransformFlag;
 };
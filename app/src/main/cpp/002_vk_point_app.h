@@ -5,7 +5,11 @@
 class VKPointApp : public VKColorApp
 {
     public:
-        VKPointApp() {};
+        VKPointApp() {
+            vertexShader = "shaders/002_shader.vert.spv";
+            pushVertexShader = "shaders/002_shader_push.vert.spv";
+            fragmentShader = "shaders/002_shader.frag.spv";
+        };
         ~VKPointApp() {};
         virtual void initVulkan() override;
         virtual void render() override;
@@ -13,6 +17,9 @@ class VKPointApp : public VKColorApp
         virtual void cleanupSwapChain() override;
         virtual void reset(ANativeWindow *newWindow, AAssetManager *newManager) override;
     protected:
-        virtual void createGraphicsPipeline() override;
+        virtual VKPipelineState getPipelineState() override;
         virtual void fillVertexData() override;
+
+        // SPEC_CONSTANT_POINT_SIZE of 002_shader.vert.
+        float pointSize = 20.0f;
 };
@@ -14,6 +14,10 @@ class VKLineApp : public VKColorApp
         virtual void reset(ANativeWindow *newWindow, AAssetManager *newManager) override;
     protected:
         virtual void fillVertexData() override;
-        virtual void createGraphicsPipeline() override;
-        virtual void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) override;
+        virtual VKPipelineState getPipelineState() override;
+        virtual void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                                 uint32_t drawCount) override;
+
+        // dynamic, set by recordDraws().
+        float lineWidth = 20.0f;
 };
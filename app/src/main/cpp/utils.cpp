@@ -1,4 +1,7 @@
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <array>
 
 #include "utils.h"
@@ -8,6 +11,20 @@ std::vector<const char *> getRequiredExtensions(bool enableValidationLayers)
     std::vector<const char *> extensions;
     extensions.push_back("VK_KHR_surface");
     extensions.push_back("VK_KHR_android_surface");
+    // provides vkGetPhysicalDeviceProperties2KHR, used to query device extension
+    // limits such as the dynamic topology of VK_EXT_extended_dynamic_state3.
+    // Also required by device extensions such as VK_KHR_timeline_semaphore on
+    // a Vulkan 1.0 instance.
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> available(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, available.data());
+    for (const auto &extension : available) {
+        if (strcmp(extension.extensionName,
+                   VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+            extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
+    }
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
@@ -30,6 +47,56 @@ std::vector<uint8_t> LoadBinaryFileToVector(const char *file_path,
     return file_content;
 }
 
+bool ReadFileToVector(const std::string &path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        data.resize(static_cast<size_t>(size));
+        ok = fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+
+    return ok;
+}
+
+bool WriteFileAtomic(const std::string &path, const std::vector<uint8_t> &data)
+{
+    std::string tempPath = path + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    // on disk before the rename, or a crash could leave an empty file behind it.
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    // rename() replaces the old file atomically.
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t HashFNV1a(const void *data, size_t size, uint64_t hash)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
 const char *toStringMessageSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT s) {
     switch (s) {
         case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
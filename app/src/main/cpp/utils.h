@@ -5,9 +5,11 @@
 #include <android/native_window.h>
 #include <android/native_window_jni.h>
 #include <vulkan/vulkan.h>
+#include "vk_host_allocator.h"
 
 #include <vector>
 #include <memory>
+#include <string>
 #include <optional>
 
 #include <glm/glm.hpp>
@@ -16,7 +18,9 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// upper bound of VKBaseApp::framesInFlight, per frame resources are
+// created for this many frames so the count can change at runtime.
+const int MAX_FRAMES_IN_FLIGHT = 4;
 
 struct ANativeWindowDeleter {
     void operator()(ANativeWindow *window) { ANativeWindow_release(window); }
@@ -24,11 +28,22 @@ struct ANativeWindowDeleter {
 
 struct UniformBufferObject {
     glm::mat4 mvp;
+    // background color of the 000 sample, the other shaders only read mvp.
+    glm::vec4 clearColor;
 };
 
+// per-draw data pushed with vkCmdPushConstants, see shaders/001_shader_push.vert.
+struct PushConstantObject {
+    glm::mat4 mvp;
+};
+// maxPushConstantsSize is at least 128 on every device.
+static_assert(sizeof(PushConstantObject) <= 128, "push constants too big");
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // a transfer-only family when the device has one, graphicsFamily otherwise.
+    std::optional<uint32_t> transferFamily;
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
     }
@@ -65,13 +80,23 @@ struct Vertex {
     } while (0)
 
 #define MAX_int64		((int64_t)	0x7fffffffffffffff)
-#define VULKAN_CPU_ALLOCATOR nullptr
+#define VULKAN_CPU_ALLOCATOR (VKHostAllocator::getCallbacks())
 
 std::vector<const char *> getRequiredExtensions(bool enableValidationLayers);
 
 std::vector<uint8_t> LoadBinaryFileToVector(const char *file_path,
                                             AAssetManager *assetManager);
 
+// files in the app's internal storage, both return false on any error.
+bool ReadFileToVector(const std::string &path, std::vector<uint8_t> &data);
+// writes a temporary file and renames it over path, so a process killed
+// mid-write never leaves a torn file behind.
+bool WriteFileAtomic(const std::string &path, const std::vector<uint8_t> &data);
+
+// 64 bit FNV-1a, pass the previous result as hash to chain several ranges.
+const uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ull;
+uint64_t HashFNV1a(const void *data, size_t size, uint64_t hash = FNV1A_OFFSET_BASIS);
+
 const char *toStringMessageSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT s);
 const char *toStringMessageType(VkDebugUtilsMessageTypeFlagsEXT s);
 
@@ -1,7 +1,29 @@
 #pragma once
 
 #include "utils.h"
+#include "vk_memory_allocator.h"
+#include "vk_uniform_ring_buffer.h"
+#include "vk_upload_manager.h"
+#include "vk_geometry_pool.h"
+#include "vk_depth_attachment.h"
+#include "vk_frame_latency.h"
+#include "vk_frame_sync.h"
+#include "vk_present_policy.h"
+#include "vk_deletion_queue.h"
+#include "vk_command_buffer_cache.h"
+#include "vk_job_system.h"
+#include "vk_parallel_recorder.h"
+#include "vk_init_graph.h"
+#include "vk_pipeline_cache.h"
+#include "vk_pipeline_registry.h"
+#include "vk_dynamic_state.h"
+#include "vk_shader_cache.h"
+#include "vk_layout_cache.h"
+#include <android/looper.h>
+#include <atomic>
 #include <string>
+#include <map>
+#include <algorithm>
 
 class VKBaseApp
 {
@@ -18,9 +40,12 @@ class VKBaseApp
         };
         virtual void render() = 0;
         virtual void cleanup() {
+            jobSystem.destroy();
             destroyDebugMessenger();
             destroySurface();
             destroyInstance();
+            VKHostAllocator::get().logStats("cleanup");
+            VKHostAllocator::get().destroy();
 
             return;
         }
@@ -32,6 +57,7 @@ class VKBaseApp
                 createSurface();
                 // recreateSwapChain();
             }
+            invalidate();
 
             return;
         };
@@ -40,7 +66,7 @@ class VKBaseApp
 
         virtual void destroyInstance() {
             if (instance) {
-                vkDestroyInstance(instance, nullptr);
+                vkDestroyInstance(instance, VULKAN_CPU_ALLOCATOR);
             }
 
             return;
@@ -54,15 +80,31 @@ class VKBaseApp
             VkDebugUtilsMessengerCreateInfoEXT createInfo{};
             populateDebugMessengerCreateInfo(createInfo);
 
-            VK_CHECK(CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr,
+            VK_CHECK(CreateDebugUtilsMessengerEXT(instance, &createInfo, VULKAN_CPU_ALLOCATOR,
                                                     &debugMessenger));
 
             return;
         }
 
+        /*
+        * Starts the worker threads, called by initVulkan() before anything
+        * that schedules jobs.
+        */
+        void initJobSystem() {
+            jobSystem.init(jobWorkerCount, enableCorePinning);
+            if (enableBenchmarks) {
+                jobSystem.benchmark();
+                bool passed = jobSystem.testCounterLifetime();
+                assert(passed);  // a job counter was used after it was destroyed!
+                (void)passed;
+            }
+
+            return;
+        }
+
         virtual void destroyDebugMessenger() {
             if (enableValidationLayers) {
-                DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+                DestroyDebugUtilsMessengerEXT(instance, debugMessenger, VULKAN_CPU_ALLOCATOR);
             }
 
             return;
@@ -85,14 +127,14 @@ class VKBaseApp
                 .window = window.get()};
 
             VK_CHECK(vkCreateAndroidSurfaceKHR(instance, &create_info,
-                                                nullptr /* pAllocator */, &surface));
+                                                VULKAN_CPU_ALLOCATOR, &surface));
 
             return;
         }
 
         virtual void destroySurface() {
             if (surface) {
-                vkDestroySurfaceKHR(instance, surface, nullptr);
+                vkDestroySurfaceKHR(instance, surface, VULKAN_CPU_ALLOCATOR);
             }
 
             return;
@@ -101,13 +143,116 @@ class VKBaseApp
     public:
         bool initialized = false;
 
+        /*
+        * Selects how many frames the CPU may queue ahead of the GPU, from 1
+        * (lowest latency) to MAX_FRAMES_IN_FLIGHT (most throughput). Can be
+        * called at any time, render() applies it before the next frame
+        * without recreating the device or the swapchain.
+        */
+        void setFramesInFlight(uint32_t count) {
+            requestedFramesInFlight = std::min<uint32_t>(
+                std::max<uint32_t>(count, 1), MAX_FRAMES_IN_FLIGHT);
+            invalidate();
+
+            return;
+        }
+
+        /*
+        * Selects the present mode and swapchain image count, see
+        * vk_present_policy.h. Can be called at any time, render() recreates
+        * the swapchain before the next frame when the goal changed.
+        */
+        void setPresentGoal(VKPresentGoal goal) {
+            requestedPresentGoal = goal;
+            invalidate();
+
+            return;
+        }
+
+        /*
+        * Directory for files kept across launches (the pipeline cache),
+        * the activity's internalDataPath. Set before initVulkan().
+        */
+        void setDataPath(const char *path) {
+            dataPath = path != nullptr ? path : "";
+
+            return;
+        }
+
+        /*
+        * Looper of the thread running the main loop, woken by
+        * invalidateAsync(). Set before initVulkan().
+        */
+        void setLooper(ALooper *looper) {
+            this->looper = looper;
+
+            return;
+        }
+
+        /*
+        * Writes the pipeline cache and the shader module identifiers to
+        * dataPath if they changed since the last save. Called when the app
+        * is stopped, Android may kill it without a cleanup() afterwards.
+        */
+        void savePipelineCache() {
+            if (initialized) {
+                pipelineCache.save();
+                shaderCache.save();
+            }
+
+            return;
+        }
+
+        /*
+        * On-demand rendering: the main loop only calls render() while
+        * needsRender() is true and otherwise blocks in the looper. Anything
+        * that changes what is on screen (content, input, surface, rotation)
+        * calls invalidate(), render() clears the flag once it starts a
+        * frame. Animated samples invalidate themselves every frame.
+        */
+        void invalidate() {
+            dirty = true;
+
+            return;
+        }
+
+        /*
+        * invalidate() for other threads, e.g. a finished pipeline compile:
+        * also wakes the main loop if it is blocked in the looper.
+        */
+        void invalidateAsync() {
+            dirty = true;
+            if (looper != nullptr) {
+                ALooper_wake(looper);
+            }
+
+            return;
+        }
+
+        bool needsRender() const {
+            // a pending rotation is only picked up by the next present.
+            return dirty || orientationChanged || !enableOnDemandRendering;
+        }
+
+        /*
+        * Called by the main loop right before it blocks in the looper. The
+        * time until the next render() is idle, not frame time, so the frame
+        * timers drop their last timestamps.
+        */
+        void onIdle() {
+            swapchainHitch.onIdle();
+            frameLatency.onIdle();
+
+            return;
+        }
+
     protected:
         struct GPUBuffer {
-            VkDeviceMemory memory;
+            VKAllocation allocation;
             VkBuffer buffer;
 
             GPUBuffer()
-                : memory(VK_NULL_HANDLE)
+                : allocation()
                 , buffer(VK_NULL_HANDLE) {}
         };
 
@@ -124,7 +269,73 @@ class VKBaseApp
         * The validation layers are not shipped with the APK as they are sizeable.
         */
         bool enableValidationLayers = false;
+        /*
+        * Toggle this to true to run the micro benchmarks and self tests at init
+        * time, their results are written to logcat under the "hellovk" tag.
+        */
+        bool enableBenchmarks = false;
+        /*
+        * Adds a depth/stencil attachment to the swapchain render pass and
+        * enables depth testing in the pipelines, see vk_depth_attachment.h.
+        */
+        bool enableDepthBuffer = true;
+        /*
+        * Recreates the swapchain with the retiring one as oldSwapchain and
+        * defers destroying the old objects to deletionQueue, so rotation
+        * does not drain the GPU. Set it to false to compare the hitch
+        * against the vkDeviceWaitIdle path.
+        */
+        bool enableDeferredSwapchainRecreation = true;
+        /*
+        * Toggle this to false to render continuously, even when nothing
+        * invalidated the app.
+        */
+        bool enableOnDemandRendering = true;
+        /*
+        * Resubmits the command buffer recorded for the same frame slot and
+        * swapchain image while nothing changed, see
+        * vk_command_buffer_cache.h. Toggle off to re-record every frame.
+        */
+        bool enableCommandBufferCache = true;
+        /*
+        * Records the draws into secondary command buffers on several
+        * threads, see vk_parallel_recorder.h. Only pays off with many draws:
+        * scenes too small for more than one share are recorded inline into
+        * the primary, without secondaries, see VKParallelRecorder::isWorthIt().
+        */
+        bool enableParallelRecording = true;
+        /*
+        * Worker threads of jobSystem, 0 for one per core besides the render
+        * thread. enableCorePinning binds every worker to its own core, which
+        * avoids migrations but fights the scheduler on big.LITTLE CPUs.
+        */
+        uint32_t jobWorkerCount = 0;
+        bool enableCorePinning = false;
+        /*
+        * Sets topology, cull mode and front face while recording when the
+        * device has VK_EXT_extended_dynamic_state, so samples that only
+        * differ in them share one pipeline. Otherwise every topology keeps
+        * its own pipeline.
+        */
+        bool enableExtendedDynamicState = true;
+        /*
+        * Saves the VK_EXT_shader_module_identifier of every shader module,
+        * so the next launch creates pipelines found in the pipeline cache
+        * without reading their SPIR-V, see vk_shader_cache.h.
+        */
+        bool enableShaderModuleIdentifiers = true;
+        /*
+        * Draws with the *_push.vert shaders, which take the MVP of every draw
+        * from vkCmdPushConstants and declare no uniform buffer. Frames then
+        * allocate no uniform slot and bind no descriptor set. Toggle off to
+        * compare against the uniform buffer path, see
+        * VKColorApp::benchmarkTransforms().
+        */
+        bool enablePushConstantTransforms = true;
+        // set by invalidateAsync() on other threads.
+        std::atomic<bool> dirty{true};
         bool orientationChanged = false;
+        ALooper *looper = nullptr;
 
         VkInstance instance;
         VkSurfaceKHR surface;
@@ -134,6 +345,81 @@ class VKBaseApp
 
         VkDebugUtilsMessengerEXT debugMessenger;
 
+        /*
+        * Sub-allocates device memory for every buffer the app creates, see
+        * vk_memory_allocator.h. Subclasses init it right after the logical
+        * device is created and destroy it right before the device.
+        */
+        VKMemoryAllocator memoryAllocator;
+
+        /*
+        * GPU progress of the graphics queue, see vk_frame_sync.h. Each
+        * frame in flight is a slot, render() waits on the slot instead of a
+        * per frame fence. timelineSemaphoreSupported is filled in by
+        * createLogicalDevicesAndQueue(), which enables the extension.
+        */
+        VKFrameSync frameSync;
+        bool timelineSemaphoreSupported = false;
+        // VK_KHR_get_physical_device_properties2 is enabled on the instance,
+        // filled in by createInstance().
+        bool properties2Enabled = false;
+
+        uint32_t framesInFlight = 2;
+        uint32_t requestedFramesInFlight = 2;
+        VKFrameLatencyTracker frameLatency;
+
+        VKPresentPolicy presentPolicy;
+        VKPresentGoal requestedPresentGoal = VKPresentGoal::PowerSaving;
+
+        /*
+        * Objects still referenced by frames in flight, keyed on frameSync
+        * values and collected in render() after the slot wait. Flushed
+        * once the device is idle.
+        */
+        VKDeletionQueue deletionQueue;
+        VKHitchMeter swapchainHitch;
+
+        /*
+        * Work-stealing scheduler for engine tasks (command recording, asset
+        * and mesh processing, pipeline creation), see vk_job_system.h.
+        */
+        VKJobSystem jobSystem;
+        /*
+        * Shared by every pipeline, persisted to getPipelineCachePath(), see
+        * vk_pipeline_cache.h. Created right after the device.
+        */
+        VKPipelineCache pipelineCache;
+        std::string dataPath;
+
+        std::string getPipelineCachePath() const {
+            return dataPath.empty() ? std::string() : dataPath + "/pipeline_cache.bin";
+        }
+
+        /*
+        * Every shader module of the app, see vk_shader_cache.h. init() runs
+        * before the init graph, setDevice() right after the device.
+        */
+        VKShaderCache shaderCache;
+
+        std::string getShaderIdentifierPath() const {
+            return dataPath.empty() ? std::string() : dataPath + "/shader_identifiers.bin";
+        }
+
+        /*
+        * Descriptor set and pipeline layouts built from shader reflection,
+        * shared by shaders with the same interface, see vk_layout_cache.h.
+        */
+        VKLayoutCache layoutCache;
+        /*
+        * One VkPipeline per unique VKPipelineState, see vk_pipeline_registry.h.
+        */
+        VKPipelineRegistry pipelineRegistry;
+        /*
+        * Extended dynamic state commands, loaded by
+        * createLogicalDevicesAndQueue(), see vk_dynamic_state.h.
+        */
+        VKDynamicState dynamicState;
+
         const std::vector<const char *> validationLayers = {
             "VK_LAYER_KHRONOS_validation"};
         const std::vector<const char *> deviceExtensions = {
@@ -0,0 +1,72 @@
+#include <assert.h>
+
+#include "vk_command_buffer_cache.h"
+
+void VKCommandBufferCache::init(VkDevice device, VkCommandPool commandPool,
+                                uint32_t slotCount)
+{
+    this->device = device;
+    this->commandPool = commandPool;
+    entries.assign(slotCount, std::vector<Entry>());
+    generation = 1;
+    recordCount = 0;
+    reuseCount = 0;
+
+    return;
+}
+
+void VKCommandBufferCache::destroy()
+{
+    for (std::vector<Entry> &slotEntries : entries) {
+        for (Entry &entry : slotEntries) {
+            vkFreeCommandBuffers(device, commandPool, 1, &entry.commandBuffer);
+        }
+    }
+    entries.clear();
+
+    return;
+}
+
+VkCommandBuffer VKCommandBufferCache::get(uint32_t slot, uint32_t imageIndex,
+                                          uint64_t stateKey, bool &upToDate)
+{
+    assert(slot < entries.size());
+
+    std::vector<Entry> &slotEntries = entries[slot];
+    if (imageIndex >= slotEntries.size()) {
+        slotEntries.resize(imageIndex + 1);
+    }
+
+    Entry &entry = slotEntries[imageIndex];
+    if (entry.commandBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &entry.commandBuffer));
+    }
+
+    upToDate = entry.generation == generation && entry.stateKey == stateKey;
+    if (upToDate) {
+        reuseCount++;
+        return entry.commandBuffer;
+    }
+
+    if (entry.generation != 0) {
+        VK_CHECK(vkResetCommandBuffer(entry.commandBuffer, 0));
+    }
+    entry.generation = generation;
+    entry.stateKey = stateKey;
+    recordCount++;
+
+    return entry.commandBuffer;
+}
+
+void VKCommandBufferCache::logStats()
+{
+    LOGI("command buffer cache: %llu frames recorded, %llu reused",
+         (unsigned long long)recordCount, (unsigned long long)reuseCount);
+
+    return;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "utils.h"
+
+#include <vector>
+
+/*
+ * VKCommandBufferCache keeps one primary command buffer per (frame slot,
+ * swapchain image) pair and hands back the already recorded one as long as
+ * nothing it depends on changed, so an unchanged frame is a resubmit instead
+ * of a full re-record.
+ *
+ * Keying on the frame slot as well as the image keeps reuse safe: a command
+ * buffer is only ever submitted from its own slot, and render() waits on the
+ * slot before get(), so it is never pending when it is reset.
+ *
+ * invalidate() drops every recording, call it on swapchain recreation and on
+ * any scene change (pipelines, meshes, descriptor sets). stateKey covers what
+ * get() can't see, e.g. the dynamic uniform offset baked into the bind call.
+ * Per frame data must go through uniform buffers, never through recorded
+ * command parameters.
+ */
+class VKCommandBufferCache
+{
+    public:
+        VKCommandBufferCache() {};
+        ~VKCommandBufferCache() {};
+
+        // commandPool must have VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT.
+        void init(VkDevice device, VkCommandPool commandPool, uint32_t slotCount);
+        void destroy();
+
+        void invalidate() { generation++; }
+
+        // upToDate is false when the caller has to record the returned
+        // command buffer, it has already been reset then.
+        VkCommandBuffer get(uint32_t slot, uint32_t imageIndex, uint64_t stateKey,
+                            bool &upToDate);
+
+        void logStats();
+
+    private:
+        struct Entry {
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            // 0: never recorded.
+            uint64_t generation = 0;
+            uint64_t stateKey = 0;
+        };
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+
+        // [slot][imageIndex], the image count follows the swapchain.
+        std::vector<std::vector<Entry>> entries;
+        uint64_t generation = 1;
+
+        uint64_t recordCount = 0;
+        uint64_t reuseCount = 0;
+};
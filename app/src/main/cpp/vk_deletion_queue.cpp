@@ -0,0 +1,31 @@
+#include "vk_deletion_queue.h"
+
+void VKDeletionQueue::push(uint64_t retireValue, std::function<void()> deleter)
+{
+    entries.push_back({retireValue, std::move(deleter)});
+
+    return;
+}
+
+void VKDeletionQueue::collect(uint64_t completedValue)
+{
+    // values are pushed in increasing order, the oldest entry retires first.
+    while (!entries.empty() && entries.front().retireValue <= completedValue) {
+        std::function<void()> deleter = std::move(entries.front().deleter);
+        entries.pop_front();
+        deleter();
+    }
+
+    return;
+}
+
+void VKDeletionQueue::flush()
+{
+    while (!entries.empty()) {
+        std::function<void()> deleter = std::move(entries.front().deleter);
+        entries.pop_front();
+        deleter();
+    }
+
+    return;
+}
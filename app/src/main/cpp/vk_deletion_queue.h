@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+
+/*
+ * VKDeletionQueue defers the destruction of Vulkan objects until the GPU is
+ * done with them. push() tags a deleter with a VKFrameSync value, collect()
+ * runs every deleter whose value has completed, in push order.
+ *
+ * Used to retire a swapchain and everything built on it (image views,
+ * framebuffers, the depth attachment) without vkDeviceWaitIdle, while frames
+ * that reference them are still in flight.
+ *
+ * Not thread safe, only the render thread pushes and collects.
+ */
+class VKDeletionQueue
+{
+    public:
+        VKDeletionQueue() {};
+        ~VKDeletionQueue() {};
+
+        void push(uint64_t retireValue, std::function<void()> deleter);
+        // runs the deleters of every value <= completedValue.
+        void collect(uint64_t completedValue);
+        // runs everything, the caller makes sure the device is idle.
+        void flush();
+
+        bool empty() const { return entries.empty(); }
+
+    private:
+        struct Entry {
+            uint64_t retireValue;
+            std::function<void()> deleter;
+        };
+
+        std::deque<Entry> entries;
+};
@@ -0,0 +1,138 @@
+#include <assert.h>
+
+#include "vk_depth_attachment.h"
+
+void VKDepthAttachment::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                             VKMemoryAllocator *allocator)
+{
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    this->allocator = allocator;
+
+    // D24S8 is the cheapest format with stencil on most mobile GPUs,
+    // D16 is the last resort and has no stencil.
+    const VkFormat candidates[] = {VK_FORMAT_D24_UNORM_S8_UINT,
+                                   VK_FORMAT_D32_SFLOAT_S8_UINT,
+                                   VK_FORMAT_D16_UNORM};
+    format = VK_FORMAT_UNDEFINED;
+    for (VkFormat candidate : candidates) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidate, &properties);
+        if (properties.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            format = candidate;
+            break;
+        }
+    }
+    assert(format != VK_FORMAT_UNDEFINED);  // no supported depth format!
+
+    stencil = format != VK_FORMAT_D16_UNORM;
+
+    return;
+}
+
+void VKDepthAttachment::create(VkExtent2D extent)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK(vkCreateImage(device, &imageInfo, VULKAN_CPU_ALLOCATOR, &image));
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+    uint32_t memoryTypeIndex = allocator->findMemoryType(
+        memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    bool lazilyAllocated = memoryTypeIndex != UINT32_MAX;
+    if (!lazilyAllocated) {
+        memoryTypeIndex = allocator->findMemoryType(memRequirements.memoryTypeBits,
+                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    assert(memoryTypeIndex != UINT32_MAX);  // no memory type for the depth image!
+
+    // optimal tiling images never share a block with buffers.
+    VK_CHECK(allocator->allocate(memRequirements, memoryTypeIndex, allocation, true));
+    VK_CHECK(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (stencil) {
+        viewInfo.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(device, &viewInfo, VULKAN_CPU_ALLOCATOR, &view));
+
+    LOGI("depth attachment %ux%u format %d, %s memory, %llu bytes committed up front",
+         extent.width, extent.height, format,
+         lazilyAllocated ? "lazily allocated" : "device local",
+         lazilyAllocated ? 0ull : (unsigned long long)memRequirements.size);
+
+    return;
+}
+
+void VKDepthAttachment::destroy()
+{
+    if (image == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkDestroyImageView(device, view, VULKAN_CPU_ALLOCATOR);
+    vkDestroyImage(device, image, VULKAN_CPU_ALLOCATOR);
+    allocator->free(allocation);
+    view = VK_NULL_HANDLE;
+    image = VK_NULL_HANDLE;
+
+    return;
+}
+
+void VKDepthAttachment::retire(VKDeletionQueue &deletionQueue, uint64_t retireValue)
+{
+    if (image == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // the copy owns the old image, this one is free for the next create().
+    VKDepthAttachment retired = *this;
+    deletionQueue.push(retireValue, [retired]() mutable { retired.destroy(); });
+    view = VK_NULL_HANDLE;
+    image = VK_NULL_HANDLE;
+
+    return;
+}
+
+VkAttachmentDescription VKDepthAttachment::getAttachmentDescription() const
+{
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = format;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    depthAttachment.stencilLoadOp = stencil ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                                            : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    return depthAttachment;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vk_memory_allocator.h"
+#include "vk_deletion_queue.h"
+
+/*
+ * VKDepthAttachment owns the depth/stencil image of the swapchain
+ * framebuffers.
+ *
+ * Depth only lives for the duration of the render pass: it is cleared on load
+ * and never stored, so the image is created with TRANSIENT_ATTACHMENT usage
+ * and bound to LAZILY_ALLOCATED memory when the driver exposes such a memory
+ * type. On tile based GPUs it then stays in tile memory and never gets a
+ * DRAM backing, no footprint and no bandwidth. Other drivers get regular
+ * DEVICE_LOCAL memory.
+ *
+ * init() picks the format once, so the render pass can be created.
+ * create() / destroy() follow the swapchain, i.e. createFramebuffers() and
+ * cleanupSwapChain(). retire() hands the image to a deletion queue instead,
+ * for a swapchain recreated while its frames are still in flight.
+ */
+class VKDepthAttachment
+{
+    public:
+        VKDepthAttachment() {};
+        ~VKDepthAttachment() {};
+
+        void init(VkPhysicalDevice physicalDevice, VkDevice device,
+                  VKMemoryAllocator *allocator);
+        void create(VkExtent2D extent);
+        void destroy();
+        void retire(VKDeletionQueue &deletionQueue, uint64_t retireValue);
+
+        // loadOp CLEAR, storeOp DONT_CARE, for the render pass.
+        VkAttachmentDescription getAttachmentDescription() const;
+
+        VkFormat getFormat() const { return format; }
+        VkImageView getView() const { return view; }
+        bool hasStencil() const { return stencil; }
+
+    private:
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        VKMemoryAllocator *allocator = nullptr;
+
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        bool stencil = false;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VKAllocation allocation;
+};
@@ -0,0 +1,156 @@
+#include <string.h>
+
+#include "vk_dynamic_state.h"
+
+VKDynamicStateSupport VKDynamicState::query(VkInstance instance,
+                                            VkPhysicalDevice physicalDevice)
+{
+    VKDynamicStateSupport support;
+
+    // the extensions depend on VK_KHR_get_physical_device_properties2.
+    auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+    if (getProperties2 == nullptr) {
+        return support;
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                         extensions.data());
+
+    bool extendedDynamicState3 = false;
+    for (const auto &extension : extensions) {
+        if (strcmp(extension.extensionName,
+                   VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) == 0) {
+            support.extendedDynamicState = true;
+        } else if (strcmp(extension.extensionName,
+                          VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME) == 0) {
+            support.extendedDynamicState2 = true;
+        }
+#ifdef VK_EXT_extended_dynamic_state3
+        else if (strcmp(extension.extensionName,
+                        VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0) {
+            extendedDynamicState3 = true;
+        }
+#endif
+    }
+
+#ifdef VK_EXT_extended_dynamic_state3
+    if (support.extendedDynamicState && extendedDynamicState3) {
+        VkPhysicalDeviceExtendedDynamicState3PropertiesEXT properties3{};
+        properties3.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties3;
+        getProperties2(physicalDevice, &properties);
+        support.unrestrictedTopology =
+            properties3.dynamicPrimitiveTopologyUnrestricted == VK_TRUE;
+    }
+#endif
+    (void)extendedDynamicState3;
+
+    LOGI("extended dynamic state: %s, 2: %s, unrestricted topology: %s",
+         support.extendedDynamicState ? "yes" : "no",
+         support.extendedDynamicState2 ? "yes" : "no",
+         support.unrestrictedTopology ? "yes" : "no");
+
+    return support;
+}
+
+void VKDynamicState::enable(const VKDynamicStateSupport &support,
+                            std::vector<const char *> &extensions,
+                            DeviceFeatures &features, const void **pNext)
+{
+    features = DeviceFeatures{};
+    if (support.extendedDynamicState) {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        features.extendedDynamicState.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        features.extendedDynamicState.extendedDynamicState = VK_TRUE;
+        features.extendedDynamicState.pNext = const_cast<void *>(*pNext);
+        *pNext = &features.extendedDynamicState;
+    }
+    if (support.extendedDynamicState2) {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+        features.extendedDynamicState2.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+        features.extendedDynamicState2.extendedDynamicState2 = VK_TRUE;
+        features.extendedDynamicState2.pNext = const_cast<void *>(*pNext);
+        *pNext = &features.extendedDynamicState2;
+    }
+#ifdef VK_EXT_extended_dynamic_state3
+    // only for the unrestricted topology property, no feature to enable.
+    if (support.unrestrictedTopology) {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+    }
+#endif
+
+    return;
+}
+
+void VKDynamicState::init(VkDevice device, const VKDynamicStateSupport &support)
+{
+    this->support = support;
+    setPrimitiveTopology = nullptr;
+    setCullMode = nullptr;
+    setFrontFace = nullptr;
+    setPrimitiveRestartEnable = nullptr;
+
+    if (support.extendedDynamicState) {
+        setCullMode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(
+            vkGetDeviceProcAddr(device, "vkCmdSetCullModeEXT"));
+        setFrontFace = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(
+            vkGetDeviceProcAddr(device, "vkCmdSetFrontFaceEXT"));
+        // set last, isEnabled() checks it.
+        if (setCullMode != nullptr && setFrontFace != nullptr) {
+            setPrimitiveTopology = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(
+                vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveTopologyEXT"));
+        }
+    }
+    if (isEnabled() && support.extendedDynamicState2) {
+        setPrimitiveRestartEnable = reinterpret_cast<PFN_vkCmdSetPrimitiveRestartEnableEXT>(
+            vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveRestartEnableEXT"));
+    }
+
+    return;
+}
+
+VkPrimitiveTopology VKDynamicState::getPipelineTopology(VkPrimitiveTopology topology) const
+{
+    if (support.unrestrictedTopology) {
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+
+    switch (topology) {
+        case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+            return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+            return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+        case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+            return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+        default:
+            return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+void VKDynamicState::record(VkCommandBuffer commandBuffer, VkPrimitiveTopology topology,
+                            VkCullModeFlags cullMode, VkFrontFace frontFace,
+                            float lineWidth)
+{
+    setPrimitiveTopology(commandBuffer, topology);
+    setCullMode(commandBuffer, cullMode);
+    setFrontFace(commandBuffer, frontFace);
+    if (setPrimitiveRestartEnable != nullptr) {
+        setPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+    }
+    // line width is dynamic as well, the pipeline is shared with lines.
+    vkCmdSetLineWidth(commandBuffer, lineWidth);
+
+    return;
+}
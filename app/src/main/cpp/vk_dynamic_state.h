@@ -0,0 +1,67 @@
+#pragma once
+
+#include "utils.h"
+
+#include <vector>
+
+struct VKDynamicStateSupport {
+    // VK_EXT_extended_dynamic_state: topology, cull mode, front face.
+    bool extendedDynamicState = false;
+    // VK_EXT_extended_dynamic_state2: primitive restart.
+    bool extendedDynamicState2 = false;
+    // VK_EXT_extended_dynamic_state3 dynamicPrimitiveTopologyUnrestricted.
+    bool unrestrictedTopology = false;
+};
+
+/*
+ * VKDynamicState sets topology, cull mode and front face while recording
+ * instead of baking them into the pipeline, so pipelines that only differ
+ * in those are one pipeline.
+ *
+ * The topology set with vkCmdSetPrimitiveTopologyEXT must be of the same
+ * class (points, lines, triangles) as the one the pipeline was created
+ * with, unless the device reports dynamicPrimitiveTopologyUnrestricted.
+ * getPipelineTopology() maps a topology to the one its shared pipeline is
+ * created with: one pipeline per class, or a single one for all.
+ *
+ * Without the extension isEnabled() is false and the pipeline registry
+ * keeps creating a pipeline per topology.
+ */
+class VKDynamicState
+{
+    public:
+        // the device extensions imply their base features.
+        static VKDynamicStateSupport query(VkInstance instance, VkPhysicalDevice physicalDevice);
+
+        // the extension names and feature structs vkCreateDevice needs for
+        // support, chained in front of *pNext. features must outlive the call.
+        struct DeviceFeatures {
+            VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicState;
+            VkPhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2;
+        };
+        static void enable(const VKDynamicStateSupport &support,
+                           std::vector<const char *> &extensions,
+                           DeviceFeatures &features, const void **pNext);
+
+        VKDynamicState() {};
+        ~VKDynamicState() {};
+
+        // support as passed to enable(), loads the commands.
+        void init(VkDevice device, const VKDynamicStateSupport &support);
+
+        bool isEnabled() const { return setPrimitiveTopology != nullptr; }
+        bool hasPrimitiveRestart() const { return setPrimitiveRestartEnable != nullptr; }
+
+        VkPrimitiveTopology getPipelineTopology(VkPrimitiveTopology topology) const;
+
+        // the state of a pipeline created with enabled dynamic state.
+        void record(VkCommandBuffer commandBuffer, VkPrimitiveTopology topology,
+                    VkCullModeFlags cullMode, VkFrontFace frontFace, float lineWidth);
+
+    private:
+        VKDynamicStateSupport support;
+        PFN_vkCmdSetPrimitiveTopologyEXT setPrimitiveTopology = nullptr;
+        PFN_vkCmdSetCullModeEXT setCullMode = nullptr;
+        PFN_vkCmdSetFrontFaceEXT setFrontFace = nullptr;
+        PFN_vkCmdSetPrimitiveRestartEnableEXT setPrimitiveRestartEnable = nullptr;
+};
@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "vk_frame_latency.h"
+
+void VKFrameLatencyTracker::reset(uint32_t framesInFlight)
+{
+    this->framesInFlight = framesInFlight;
+    std::fill(pending, pending + MAX_FRAMES_IN_FLIGHT, false);
+
+    activeStart = Clock::now();
+    activeSeconds = 0.0;
+    idle = false;
+    sampleCount = 0;
+    totalMs = 0.0;
+    minMs = 0.0;
+    maxMs = 0.0;
+
+    return;
+}
+
+void VKFrameLatencyTracker::onSubmit(uint32_t frameIndex, uint64_t frameValue)
+{
+    if (idle) {
+        activeStart = Clock::now();
+        idle = false;
+    }
+    submitTime[frameIndex] = Clock::now();
+    frameValues[frameIndex] = frameValue;
+    pending[frameIndex] = true;
+
+    return;
+}
+
+void VKFrameLatencyTracker::poll(uint64_t completedValue)
+{
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (pending[i] && frameValues[i] <= completedValue) {
+            onComplete(i);
+        }
+    }
+
+    return;
+}
+
+void VKFrameLatencyTracker::onComplete(uint32_t frameIndex)
+{
+    if (!pending[frameIndex]) {
+        return;
+    }
+    pending[frameIndex] = false;
+
+    double ms = std::chrono::duration<double, std::milli>(
+        Clock::now() - submitTime[frameIndex]).count();
+    minMs = sampleCount == 0 ? ms : std::min(minMs, ms);
+    maxMs = std::max(maxMs, ms);
+    totalMs += ms;
+    sampleCount++;
+
+    if (sampleCount == REPORT_INTERVAL) {
+        report();
+    }
+
+    return;
+}
+
+void VKFrameLatencyTracker::onIdle()
+{
+    if (idle) {
+        return;
+    }
+    std::fill(pending, pending + MAX_FRAMES_IN_FLIGHT, false);
+    activeSeconds += std::chrono::duration<double>(Clock::now() - activeStart).count();
+    idle = true;
+
+    return;
+}
+
+void VKFrameLatencyTracker::report()
+{
+    double seconds = activeSeconds;
+    if (!idle) {
+        seconds += std::chrono::duration<double>(Clock::now() - activeStart).count();
+    }
+    LOGI("%u frames in flight: submit to complete %.2f ms avg (%.2f min, %.2f max), %.1f fps",
+         framesInFlight, totalMs / sampleCount, minMs, maxMs, sampleCount / seconds);
+
+    activeStart = Clock::now();
+    activeSeconds = 0.0;
+    sampleCount = 0;
+    totalMs = 0.0;
+    minMs = 0.0;
+    maxMs = 0.0;
+
+    return;
+}
+
+void VKHitchMeter::onFrame()
+{
+    Clock::time_point now = Clock::now();
+    if (!hasLastFrame) {
+        lastFrame = now;
+        hasLastFrame = true;
+        return;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(now - lastFrame).count();
+    lastFrame = now;
+
+    if (framesLeft > 0) {
+        worstMs = std::max(worstMs, ms);
+        if (--framesLeft == 0) {
+            LOGI("%s: worst frame %.2f ms over the next %u frames, %.2f ms avg before",
+                 label, worstMs, WINDOW, baselineMs);
+        }
+        return;
+    }
+
+    // exponential moving average, hitches stay out of it.
+    averageMs = averageMs == 0.0 ? ms : averageMs * 0.9 + ms * 0.1;
+
+    return;
+}
+
+void VKHitchMeter::begin(const char *label)
+{
+    this->label = label;
+    framesLeft = WINDOW;
+    baselineMs = averageMs;
+    worstMs = 0.0;
+
+    return;
+}
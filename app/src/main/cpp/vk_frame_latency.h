@@ -0,0 +1,89 @@
+#pragma once
+
+#include "utils.h"
+
+#include <chrono>
+
+/*
+ * VKFrameLatencyTracker measures, per frame, the time from vkQueueSubmit on
+ * the CPU to the frame's VKFrameSync value completing, i.e. the latency added
+ * by queuing frames in flight.
+ *
+ * Completion is detected by comparing the frames' values against the
+ * completed value at the start of every render(), and by the slot wait
+ * itself, so the resolution is one render() call. Averages are logged every
+ * REPORT_INTERVAL frames.
+ *
+ * With on-demand rendering the loop may sleep between frames. onIdle()
+ * drops the frames still pending, their completion would only be seen by
+ * the next render(), and keeps the idle time out of the fps.
+ */
+class VKFrameLatencyTracker
+{
+    public:
+        VKFrameLatencyTracker() {};
+        ~VKFrameLatencyTracker() {};
+
+        // drops pending frames and statistics, framesInFlight is for the log.
+        void reset(uint32_t framesInFlight);
+
+        void onSubmit(uint32_t frameIndex, uint64_t frameValue);
+        // completes every pending frame whose value is <= completedValue.
+        void poll(uint64_t completedValue);
+        // the slot of frameIndex was just waited on.
+        void onComplete(uint32_t frameIndex);
+        // no render() until the app is invalidated again.
+        void onIdle();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+        static const uint32_t REPORT_INTERVAL = 300;
+
+        void report();
+
+        Clock::time_point submitTime[MAX_FRAMES_IN_FLIGHT];
+        uint64_t frameValues[MAX_FRAMES_IN_FLIGHT] = {};
+        bool pending[MAX_FRAMES_IN_FLIGHT] = {};
+        uint32_t framesInFlight = 0;
+
+        // time spent rendering in the current window, idle time excluded.
+        Clock::time_point activeStart;
+        double activeSeconds = 0.0;
+        bool idle = false;
+        uint32_t sampleCount = 0;
+        double totalMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+};
+
+/*
+ * VKHitchMeter reports how much an event, e.g. a swapchain recreation,
+ * stretches the frames following it. onFrame() is called at the start of
+ * every render(), begin() when the event happens. The worst of the next
+ * WINDOW frame intervals is logged against the average interval before.
+ * onIdle() ends the current interval, so the gap to the next frame is not
+ * mistaken for a frame.
+ */
+class VKHitchMeter
+{
+    public:
+        VKHitchMeter() {};
+        ~VKHitchMeter() {};
+
+        void onFrame();
+        void onIdle() { hasLastFrame = false; }
+        void begin(const char *label);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+        static const uint32_t WINDOW = 8;
+
+        Clock::time_point lastFrame;
+        bool hasLastFrame = false;
+        double averageMs = 0.0;
+
+        const char *label = nullptr;
+        uint32_t framesLeft = 0;
+        double baselineMs = 0.0;
+        double worstMs = 0.0;
+};
@@ -0,0 +1,181 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vk_frame_sync.h"
+
+bool VKFrameSync::isTimelineSupported(VkPhysicalDevice physicalDevice,
+                                      bool properties2Enabled)
+{
+    if (!properties2Enabled) {
+        return false;
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                         extensions.data());
+
+    for (const auto &extension : extensions) {
+        if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VKFrameSync::init(VkDevice device, bool useTimeline, uint32_t slotCount)
+{
+    this->device = device;
+    slotValues.assign(slotCount, 0);
+    submittedValue = 0;
+    completedValue = 0;
+
+    if (useTimeline) {
+        getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+            vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR"));
+        waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+            vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+        useTimeline = getSemaphoreCounterValue != nullptr && waitSemaphores != nullptr;
+    }
+
+    if (useTimeline) {
+        VkSemaphoreTypeCreateInfoKHR typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VULKAN_CPU_ALLOCATOR, &timeline));
+    } else {
+        // signaled, so waiting on a slot that was never submitted returns.
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        fences.resize(slotCount);
+        for (VkFence &fence : fences) {
+            VK_CHECK(vkCreateFence(device, &fenceInfo, VULKAN_CPU_ALLOCATOR, &fence));
+        }
+    }
+
+    LOGI("frame sync: %s, %u slots", useTimeline ? "timeline semaphore" : "fences",
+         slotCount);
+
+    return;
+}
+
+void VKFrameSync::destroy()
+{
+    if (timeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, timeline, VULKAN_CPU_ALLOCATOR);
+        timeline = VK_NULL_HANDLE;
+    }
+    for (VkFence fence : fences) {
+        vkDestroyFence(device, fence, VULKAN_CPU_ALLOCATOR);
+    }
+    fences.clear();
+    slotValues.clear();
+
+    return;
+}
+
+uint64_t VKFrameSync::submit(VkQueue queue, uint32_t slot, const VkSubmitInfo &submitInfo)
+{
+    assert(slot < slotValues.size());
+    // the slot's previous submission must be waited on before it is reused.
+    assert(isComplete(slotValues[slot]));
+
+    uint64_t value = ++submittedValue;
+    slotValues[slot] = value;
+
+    if (!usesTimeline()) {
+        VK_CHECK(vkResetFences(device, 1, &fences[slot]));
+        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fences[slot]));
+        return value;
+    }
+
+    assert(submitInfo.signalSemaphoreCount < MAX_SIGNAL_SEMAPHORES);
+
+    VkSemaphore signalSemaphores[MAX_SIGNAL_SEMAPHORES];
+    // binary semaphores ignore their value.
+    uint64_t signalValues[MAX_SIGNAL_SEMAPHORES] = {};
+    uint32_t signalCount = submitInfo.signalSemaphoreCount;
+    std::copy(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + signalCount,
+              signalSemaphores);
+    signalSemaphores[signalCount] = timeline;
+    signalValues[signalCount] = value;
+    signalCount++;
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.pNext = submitInfo.pNext;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    VkSubmitInfo timelineSubmitInfo = submitInfo;
+    timelineSubmitInfo.pNext = &timelineInfo;
+    timelineSubmitInfo.signalSemaphoreCount = signalCount;
+    timelineSubmitInfo.pSignalSemaphores = signalSemaphores;
+    VK_CHECK(vkQueueSubmit(queue, 1, &timelineSubmitInfo, VK_NULL_HANDLE));
+
+    return value;
+}
+
+uint64_t VKFrameSync::getCompletedValue()
+{
+    if (completedValue == submittedValue) {
+        return completedValue;
+    }
+
+    if (usesTimeline()) {
+        VK_CHECK(getSemaphoreCounterValue(device, timeline, &completedValue));
+        return completedValue;
+    }
+
+    // a fence also covers everything submitted to the queue before it.
+    for (size_t i = 0; i < fences.size(); i++) {
+        if (slotValues[i] > completedValue &&
+            vkGetFenceStatus(device, fences[i]) == VK_SUCCESS) {
+            completedValue = slotValues[i];
+        }
+    }
+
+    return completedValue;
+}
+
+void VKFrameSync::wait(uint64_t value)
+{
+    assert(value <= submittedValue);  // would never signal
+    if (value <= completedValue) {
+        return;
+    }
+
+    if (usesTimeline()) {
+        VkSemaphoreWaitInfoKHR waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        VK_CHECK(waitSemaphores(device, &waitInfo, UINT64_MAX));
+        completedValue = std::max(completedValue, value);
+        return;
+    }
+
+    // the oldest submission at or after value, older slots were reused already.
+    size_t waitSlot = fences.size();
+    for (size_t i = 0; i < fences.size(); i++) {
+        if (slotValues[i] >= value &&
+            (waitSlot == fences.size() || slotValues[i] < slotValues[waitSlot])) {
+            waitSlot = i;
+        }
+    }
+    assert(waitSlot < fences.size());
+    VK_CHECK(vkWaitForFences(device, 1, &fences[waitSlot], VK_TRUE, UINT64_MAX));
+    completedValue = std::max(completedValue, slotValues[waitSlot]);
+
+    return;
+}
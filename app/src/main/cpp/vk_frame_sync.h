@@ -0,0 +1,68 @@
+#pragma once
+
+#include "utils.h"
+
+#include <vector>
+
+/*
+ * VKFrameSync tracks GPU progress of one queue as a single monotonically
+ * increasing counter. Every submit() signals the next value, so "is frame N
+ * done" is a comparison against getCompletedValue(), and any resource tagged
+ * with the value of its last use can be reused once that value completed.
+ *
+ * With VK_KHR_timeline_semaphore the counter is a timeline semaphore:
+ * reading it is one vkGetSemaphoreCounterValueKHR, waiting is
+ * vkWaitSemaphoresKHR, and there is nothing to reset between frames. Binary
+ * semaphores are still needed for acquire and present, submit() only appends
+ * the timeline signal to the caller's VkSubmitInfo.
+ *
+ * Without the extension it falls back to one fence per slot. slot is the
+ * index of the per frame (or per batch) resources the submission uses, the
+ * fence of a slot is reset right before it is submitted again.
+ *
+ * Not thread safe, all calls are expected to come from one thread.
+ */
+class VKFrameSync
+{
+    public:
+        VKFrameSync() {};
+        ~VKFrameSync() {};
+
+        // the extension implies the timelineSemaphore feature.
+        // the extension needs VK_KHR_get_physical_device_properties2 on the
+        // (Vulkan 1.0) instance, properties2Enabled tells if it is enabled.
+        static bool isTimelineSupported(VkPhysicalDevice physicalDevice,
+                                        bool properties2Enabled);
+
+        void init(VkDevice device, bool useTimeline, uint32_t slotCount);
+        void destroy();
+
+        bool usesTimeline() const { return timeline != VK_NULL_HANDLE; }
+
+        // submits submitInfo signaling getSubmittedValue() + 1, returns that value.
+        uint64_t submit(VkQueue queue, uint32_t slot, const VkSubmitInfo &submitInfo);
+
+        uint64_t getSubmittedValue() const { return submittedValue; }
+        uint64_t getCompletedValue();
+        bool isComplete(uint64_t value) { return value <= getCompletedValue(); }
+        void wait(uint64_t value);
+
+        // waits for the last submission that used slot.
+        void waitForSlot(uint32_t slot) { wait(slotValues[slot]); }
+
+    private:
+        static const uint32_t MAX_SIGNAL_SEMAPHORES = 4;
+
+        VkDevice device = VK_NULL_HANDLE;
+
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+        PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+
+        // fallback only.
+        std::vector<VkFence> fences;
+
+        std::vector<uint64_t> slotValues;
+        uint64_t submittedValue = 0;
+        uint64_t completedValue = 0;
+};
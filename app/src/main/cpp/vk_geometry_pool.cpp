@@ -0,0 +1,219 @@
+#include <assert.h>
+#include <string.h>
+
+#include "vk_geometry_pool.h"
+
+void VKGeometryPool::init(VkDevice device, VKMemoryAllocator *allocator,
+                          VKUploadManager *uploadManager,
+                          const std::vector<uint32_t> &sharedFamilies,
+                          uint32_t vertexStride, uint32_t maxVertices,
+                          uint32_t maxIndices, bool allowZeroCopy)
+{
+    this->device = device;
+    this->allocator = allocator;
+    this->uploadManager = uploadManager;
+    this->sharedFamilies = sharedFamilies;
+    this->allowZeroCopy = allowZeroCopy;
+    this->vertexStride = vertexStride;
+    this->maxVertices = maxVertices;
+    this->maxIndices = maxIndices;
+
+    VkResult result = createBuffer((VkDeviceSize)vertexStride * maxVertices,
+                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer);
+    if (result == VK_SUCCESS) {
+        result = createBuffer((VkDeviceSize)maxIndices * sizeof(uint16_t),
+                              VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer);
+    }
+    // out of memory, the pool stays empty and addMesh() rejects every mesh.
+    if (result != VK_SUCCESS) {
+        LOGE("failed to create the geometry pool buffers: %d", result);
+        destroyBuffer(vertexBuffer);
+        destroyBuffer(indexBuffer);
+        this->maxVertices = 0;
+        this->maxIndices = 0;
+    }
+
+    vertexHead = 0;
+    indexHead = 0;
+    liveVertices = 0;
+    liveIndices = 0;
+    meshes.clear();
+    freeHandles.clear();
+    uploadToken = 0;
+
+    return;
+}
+
+void VKGeometryPool::destroy()
+{
+    LOGI("geometry pool: %u/%u vertices, %u/%u indices live, fragmentation %.2f",
+         liveVertices, maxVertices, liveIndices, maxIndices, getFragmentation());
+
+    destroyBuffer(vertexBuffer);
+    destroyBuffer(indexBuffer);
+    meshes.clear();
+    freeHandles.clear();
+
+    return;
+}
+
+/*
+ * DEVICE_LOCAL | HOST_VISIBLE when the device has it and zero-copy is
+ * allowed, plain DEVICE_LOCAL otherwise.
+ */
+VkResult VKGeometryPool::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                      PoolBuffer &poolBuffer)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (sharedFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = (uint32_t)sharedFamilies.size();
+        bufferInfo.pQueueFamilyIndices = sharedFamilies.data();
+    } else {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    VK_CHECK(vkCreateBuffer(device, &bufferInfo, VULKAN_CPU_ALLOCATOR, &poolBuffer.buffer));
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, poolBuffer.buffer, &memRequirements);
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    if (allowZeroCopy) {
+        memoryTypeIndex = allocator->findMemoryType(
+            memRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    }
+    if (memoryTypeIndex == UINT32_MAX) {
+        memoryTypeIndex = allocator->findMemoryType(memRequirements.memoryTypeBits,
+                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    assert(memoryTypeIndex != UINT32_MAX);  // no device local memory!
+
+    VkResult result = allocator->allocate(memRequirements, memoryTypeIndex,
+                                          poolBuffer.allocation);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    VK_CHECK(vkBindBufferMemory(device, poolBuffer.buffer, poolBuffer.allocation.memory,
+                                poolBuffer.allocation.offset));
+
+    return VK_SUCCESS;
+}
+
+void VKGeometryPool::destroyBuffer(PoolBuffer &poolBuffer)
+{
+    vkDestroyBuffer(device, poolBuffer.buffer, VULKAN_CPU_ALLOCATOR);
+    allocator->free(poolBuffer.allocation);
+    poolBuffer.buffer = VK_NULL_HANDLE;
+
+    return;
+}
+
+void VKGeometryPool::write(PoolBuffer &poolBuffer, VkDeviceSize offset,
+                           const void *data, VkDeviceSize size)
+{
+    if (poolBuffer.allocation.mappedData) {
+        memcpy(static_cast<uint8_t *>(poolBuffer.allocation.mappedData) + offset, data, size);
+        allocator->flush(poolBuffer.allocation, offset, size);
+    } else {
+        uploadToken = uploadManager->uploadBuffer(poolBuffer.buffer, offset, data, size);
+    }
+
+    return;
+}
+
+VKMeshHandle VKGeometryPool::addMesh(const void *vertices, uint32_t vertexCount,
+                                     const uint16_t *indices, uint32_t indexCount)
+{
+    if (vertexHead + vertexCount > maxVertices || indexHead + indexCount > maxIndices) {
+        LOGE("geometry pool full: %u vertices and %u indices don't fit, %u/%u and %u/%u used",
+             vertexCount, indexCount, vertexHead, maxVertices, indexHead, maxIndices);
+        return INVALID_MESH_HANDLE;
+    }
+
+    VKMeshHandle handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    } else {
+        handle = (VKMeshHandle)meshes.size();
+        meshes.emplace_back();
+    }
+
+    Mesh &mesh = meshes[handle];
+    mesh.alive = true;
+    mesh.range.firstIndex = indexHead;
+    mesh.range.indexCount = indexCount;
+    mesh.range.vertexOffset = (int32_t)vertexHead;
+    mesh.range.vertexCount = vertexCount;
+
+    write(vertexBuffer, (VkDeviceSize)vertexHead * vertexStride, vertices,
+          (VkDeviceSize)vertexCount * vertexStride);
+    write(indexBuffer, (VkDeviceSize)indexHead * sizeof(uint16_t), indices,
+          (VkDeviceSize)indexCount * sizeof(uint16_t));
+
+    vertexHead += vertexCount;
+    indexHead += indexCount;
+    liveVertices += vertexCount;
+    liveIndices += indexCount;
+
+    return handle;
+}
+
+void VKGeometryPool::removeMesh(VKMeshHandle handle)
+{
+    assert(handle < meshes.size() && meshes[handle].alive);
+
+    Mesh &mesh = meshes[handle];
+    liveVertices -= mesh.range.vertexCount;
+    liveIndices -= mesh.range.indexCount;
+    mesh = Mesh{};
+    freeHandles.push_back(handle);
+
+    // holes are only reclaimed once the pool is empty.
+    if (liveVertices == 0) {
+        vertexHead = 0;
+        indexHead = 0;
+    }
+
+    return;
+}
+
+const VKMeshRange &VKGeometryPool::getRange(VKMeshHandle handle) const
+{
+    assert(handle < meshes.size() && meshes[handle].alive);
+
+    return meshes[handle].range;
+}
+
+float VKGeometryPool::getFragmentation() const
+{
+    uint32_t used = vertexHead * vertexStride + indexHead * (uint32_t)sizeof(uint16_t);
+    if (used == 0) {
+        return 0.0f;
+    }
+    uint32_t live = liveVertices * vertexStride + liveIndices * (uint32_t)sizeof(uint16_t);
+
+    return 1.0f - (float)live / (float)used;
+}
+
+void VKGeometryPool::bind(VkCommandBuffer commandBuffer)
+{
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+    return;
+}
+
+void VKGeometryPool::draw(VkCommandBuffer commandBuffer, VKMeshHandle handle,
+                          uint32_t instanceCount)
+{
+    const VKMeshRange &range = getRange(handle);
+    vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.firstIndex,
+                     range.vertexOffset, 0);
+
+    return;
+}
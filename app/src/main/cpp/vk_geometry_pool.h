@@ -0,0 +1,108 @@
+#pragma once
+
+#include "vk_memory_allocator.h"
+#include "vk_upload_manager.h"
+
+/*
+ * Where a mesh lives inside VKGeometryPool, in the units vkCmdDrawIndexed and
+ * VkDrawIndexedIndirectCommand expect.
+ */
+struct VKMeshRange {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+};
+
+typedef uint32_t VKMeshHandle;
+const VKMeshHandle INVALID_MESH_HANDLE = UINT32_MAX;
+
+/*
+ * VKGeometryPool packs the vertex and index data of many meshes into one
+ * device local vertex buffer and one uint16 index buffer, so a frame binds
+ * geometry once and every mesh is drawn with its (firstIndex, vertexOffset).
+ *
+ * Meshes are appended at the end of both buffers. removeMesh() leaves a hole
+ * behind that is reused once every mesh was removed. Ranges never move while
+ * a mesh is alive, so baked command buffers that draw it stay valid.
+ *
+ * On unified memory the buffers are DEVICE_LOCAL | HOST_VISIBLE and written
+ * through their mapping, otherwise the data goes through the upload manager.
+ * This is the only place the app picks that memory policy, mesh data of any
+ * size goes through a pool.
+ */
+class VKGeometryPool
+{
+    public:
+        VKGeometryPool() {};
+        ~VKGeometryPool() {};
+
+        // sharedFamilies lists the queue families the buffers are used on,
+        // more than one makes them VK_SHARING_MODE_CONCURRENT. allowZeroCopy
+        // false forces the staging path, to compare both.
+        void init(VkDevice device, VKMemoryAllocator *allocator,
+                  VKUploadManager *uploadManager,
+                  const std::vector<uint32_t> &sharedFamilies,
+                  uint32_t vertexStride, uint32_t maxVertices, uint32_t maxIndices,
+                  bool allowZeroCopy = true);
+        void destroy();
+
+        // indices are relative to the mesh's own vertices. Returns
+        // INVALID_MESH_HANDLE when the mesh does not fit behind the last one.
+        VKMeshHandle addMesh(const void *vertices, uint32_t vertexCount,
+                             const uint16_t *indices, uint32_t indexCount);
+        void removeMesh(VKMeshHandle handle);
+        const VKMeshRange &getRange(VKMeshHandle handle) const;
+
+        // share of the used space taken by removed meshes.
+        float getFragmentation() const;
+        // the buffers are written through their mapping, no upload needed.
+        bool isZeroCopy() const { return vertexBuffer.allocation.mappedData != nullptr; }
+
+        // upload token of the latest staged addMesh(), addMesh() does not
+        // flush so many meshes share one batch.
+        VKUploadToken getUploadToken() const { return uploadToken; }
+
+        void bind(VkCommandBuffer commandBuffer);
+        void draw(VkCommandBuffer commandBuffer, VKMeshHandle handle,
+                  uint32_t instanceCount = 1);
+
+    private:
+        struct Mesh {
+            VKMeshRange range;
+            bool alive = false;
+        };
+
+        struct PoolBuffer {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VKAllocation allocation;
+        };
+
+        VkResult createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                              PoolBuffer &poolBuffer);
+        void destroyBuffer(PoolBuffer &poolBuffer);
+        void write(PoolBuffer &poolBuffer, VkDeviceSize offset, const void *data,
+                   VkDeviceSize size);
+
+        VkDevice device = VK_NULL_HANDLE;
+        VKMemoryAllocator *allocator = nullptr;
+        VKUploadManager *uploadManager = nullptr;
+        std::vector<uint32_t> sharedFamilies;
+        bool allowZeroCopy = true;
+
+        PoolBuffer vertexBuffer;
+        PoolBuffer indexBuffer;
+        uint32_t vertexStride = 0;
+        uint32_t maxVertices = 0;
+        uint32_t maxIndices = 0;
+
+        // append cursors and the amount of data still referenced behind them.
+        uint32_t vertexHead = 0;
+        uint32_t indexHead = 0;
+        uint32_t liveVertices = 0;
+        uint32_t liveIndices = 0;
+
+        std::vector<Mesh> meshes;
+        std::vector<VKMeshHandle> freeHandles;
+        VKUploadToken uploadToken = 0;
+};
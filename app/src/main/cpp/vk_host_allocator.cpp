@@ -0,0 +1,297 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "utils.h"
+#include "vk_host_allocator.h"
+
+namespace {
+
+struct AllocationHeader {
+    uint64_t size;
+    uint32_t offset;    // from the start of the block to the returned pointer
+    uint8_t scope;
+    uint8_t sizeClass;
+    uint16_t reserved;
+};
+static_assert(sizeof(AllocationHeader) == 16, "header must keep 16 byte alignment");
+
+const uint8_t NOT_POOLED = 0xff;
+const size_t MIN_BLOCK_SIZE = 64;
+
+const char *scopeNames[] = {"command", "object", "cache", "device", "instance"};
+
+AllocationHeader *getHeader(void *memory)
+{
+    return reinterpret_cast<AllocationHeader *>(memory) - 1;
+}
+
+bool isPooledScope(VkSystemAllocationScope scope)
+{
+    return scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT ||
+           scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND;
+}
+
+} // namespace
+
+VKHostAllocator &VKHostAllocator::get()
+{
+    static VKHostAllocator allocator;
+    return allocator;
+}
+
+const VkAllocationCallbacks *VKHostAllocator::getCallbacks()
+{
+    return &get().callbacks;
+}
+
+VKHostAllocator::VKHostAllocator()
+{
+    callbacks.pUserData = this;
+    callbacks.pfnAllocation = allocationCallback;
+    callbacks.pfnReallocation = reallocationCallback;
+    callbacks.pfnFree = freeCallback;
+    callbacks.pfnInternalAllocation = internalAllocationCallback;
+    callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+/*
+ * Arenas are MIN_BLOCK_SIZE aligned and every size class is a multiple of
+ * MIN_BLOCK_SIZE, so pooled blocks are suitably aligned for the header and
+ * any request with alignment <= sizeof(AllocationHeader).
+ */
+void *VKHostAllocator::allocateFromPool(Pool &pool, uint32_t sizeClass)
+{
+    FreeBlock *&freeList = pool.freeLists[sizeClass];
+    if (freeList == nullptr) {
+        size_t blockSize = MIN_BLOCK_SIZE << sizeClass;
+        void *arena = nullptr;
+        if (posix_memalign(&arena, MIN_BLOCK_SIZE, ARENA_SIZE) != 0) {
+            return nullptr;
+        }
+        pool.arenas.push_back(arena);
+
+        uint8_t *blocks = static_cast<uint8_t *>(arena);
+        for (size_t offset = 0; offset + blockSize <= ARENA_SIZE; offset += blockSize) {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(blocks + offset);
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+
+    FreeBlock *block = freeList;
+    freeList = block->next;
+
+    return block;
+}
+
+void *VKHostAllocator::allocate(size_t size, size_t alignment,
+                                VkSystemAllocationScope scope)
+{
+    if (size == 0) {
+        return nullptr;
+    }
+
+    alignment = std::max(alignment, sizeof(AllocationHeader));
+    size_t blockSize = size + sizeof(AllocationHeader);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint8_t *base = nullptr;
+    uint32_t offset = sizeof(AllocationHeader);
+    uint8_t sizeClass = NOT_POOLED;
+
+    if (isPooledScope(scope) && alignment == sizeof(AllocationHeader) &&
+        blockSize <= (MIN_BLOCK_SIZE << (SIZE_CLASS_COUNT - 1))) {
+        uint8_t c = 0;
+        while ((MIN_BLOCK_SIZE << c) < blockSize) {
+            c++;
+        }
+        base = static_cast<uint8_t *>(allocateFromPool(pools[scope], c));
+        sizeClass = c;
+    } else {
+        // the header lives right in front of the aligned pointer.
+        void *memory = nullptr;
+        if (posix_memalign(&memory, alignment, alignment + size) == 0) {
+            base = static_cast<uint8_t *>(memory);
+        }
+        offset = (uint32_t)alignment;
+    }
+
+    if (base == nullptr) {
+        return nullptr;  // VK_ERROR_OUT_OF_HOST_MEMORY for the caller
+    }
+
+    void *memory = base + offset;
+    AllocationHeader *header = getHeader(memory);
+    header->size = size;
+    header->offset = offset;
+    header->scope = (uint8_t)scope;
+    header->sizeClass = sizeClass;
+    header->reserved = 0;
+
+    VKHostAllocStats &scopeStats = stats[scope];
+    scopeStats.allocationCount++;
+    scopeStats.liveAllocations++;
+    scopeStats.liveBytes += size;
+    scopeStats.peakBytes = std::max(scopeStats.peakBytes, scopeStats.liveBytes);
+    scopeStats.pooledAllocations += sizeClass != NOT_POOLED ? 1 : 0;
+
+    return memory;
+}
+
+void VKHostAllocator::free(void *memory)
+{
+    if (memory == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    AllocationHeader *header = getHeader(memory);
+    uint8_t *base = static_cast<uint8_t *>(memory) - header->offset;
+
+    VKHostAllocStats &scopeStats = stats[header->scope];
+    scopeStats.freeCount++;
+    scopeStats.liveAllocations--;
+    scopeStats.liveBytes -= header->size;
+
+    if (header->sizeClass == NOT_POOLED) {
+        ::free(base);
+        return;
+    }
+
+    FreeBlock *block = reinterpret_cast<FreeBlock *>(base);
+    FreeBlock *&freeList = pools[header->scope].freeLists[header->sizeClass];
+    block->next = freeList;
+    freeList = block;
+
+    return;
+}
+
+void *VKHostAllocator::reallocate(void *original, size_t size, size_t alignment,
+                                  VkSystemAllocationScope scope)
+{
+    if (original == nullptr) {
+        return allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        free(original);
+        return nullptr;
+    }
+
+    AllocationHeader *header = getHeader(original);
+    size_t oldSize = header->size;
+
+    // pooled blocks have slack up to their size class, grow in place.
+    if (header->sizeClass != NOT_POOLED &&
+        size + sizeof(AllocationHeader) <= (MIN_BLOCK_SIZE << header->sizeClass)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        VKHostAllocStats &scopeStats = stats[header->scope];
+        scopeStats.liveBytes = scopeStats.liveBytes - oldSize + size;
+        scopeStats.peakBytes = std::max(scopeStats.peakBytes, scopeStats.liveBytes);
+        header->size = size;
+        return original;
+    }
+
+    void *memory = allocate(size, alignment, scope);
+    if (memory == nullptr) {
+        return nullptr;  // the original allocation stays valid
+    }
+    memcpy(memory, original, std::min(oldSize, size));
+    free(original);
+
+    return memory;
+}
+
+VKHostAllocStats VKHostAllocator::getStats(VkSystemAllocationScope scope)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats[scope];
+}
+
+void VKHostAllocator::logStats(const char *label)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    LOGI("host allocations after %s:", label);
+    for (uint32_t i = 0; i < SCOPE_COUNT; i++) {
+        const VKHostAllocStats &s = stats[i];
+        const VKHostAllocStats &last = lastLogged[i];
+        if (s.allocationCount == 0 && s.internalBytes == 0) {
+            continue;
+        }
+
+        LOGI("\t %-8s live %llu (%llu bytes, peak %llu), internal %llu bytes, "
+             "+%llu allocs / +%llu frees since last report, %llu%% pooled",
+             scopeNames[i], (unsigned long long)s.liveAllocations,
+             (unsigned long long)s.liveBytes, (unsigned long long)s.peakBytes,
+             (unsigned long long)s.internalBytes,
+             (unsigned long long)(s.allocationCount - last.allocationCount),
+             (unsigned long long)(s.freeCount - last.freeCount),
+             (unsigned long long)(s.pooledAllocations * 100 / s.allocationCount));
+    }
+
+    std::copy(stats, stats + SCOPE_COUNT, lastLogged);
+
+    return;
+}
+
+void VKHostAllocator::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (uint32_t i = 0; i < SCOPE_COUNT; i++) {
+        if (stats[i].liveAllocations > 0) {
+            LOGE("%llu %s scope host allocations still alive, arenas kept",
+                 (unsigned long long)stats[i].liveAllocations, scopeNames[i]);
+            continue;
+        }
+
+        for (void *arena : pools[i].arenas) {
+            ::free(arena);
+        }
+        pools[i] = Pool{};
+    }
+
+    return;
+}
+
+void *VKAPI_PTR VKHostAllocator::allocationCallback(void *pUserData, size_t size,
+                                                    size_t alignment,
+                                                    VkSystemAllocationScope scope)
+{
+    return static_cast<VKHostAllocator *>(pUserData)->allocate(size, alignment, scope);
+}
+
+void *VKAPI_PTR VKHostAllocator::reallocationCallback(void *pUserData, void *pOriginal,
+                                                      size_t size, size_t alignment,
+                                                      VkSystemAllocationScope scope)
+{
+    return static_cast<VKHostAllocator *>(pUserData)->reallocate(pOriginal, size,
+                                                                 alignment, scope);
+}
+
+void VKAPI_PTR VKHostAllocator::freeCallback(void *pUserData, void *pMemory)
+{
+    static_cast<VKHostAllocator *>(pUserData)->free(pMemory);
+}
+
+void VKAPI_PTR VKHostAllocator::internalAllocationCallback(void *pUserData, size_t size,
+                                                           VkInternalAllocationType type,
+                                                           VkSystemAllocationScope scope)
+{
+    VKHostAllocator *allocator = static_cast<VKHostAllocator *>(pUserData);
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    allocator->stats[scope].internalBytes += size;
+}
+
+void VKAPI_PTR VKHostAllocator::internalFreeCallback(void *pUserData, size_t size,
+                                                     VkInternalAllocationType type,
+                                                     VkSystemAllocationScope scope)
+{
+    VKHostAllocator *allocator = static_cast<VKHostAllocator *>(pUserData);
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    allocator->stats[scope].internalBytes -= size;
+}
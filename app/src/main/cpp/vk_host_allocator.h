@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <vector>
+
+/*
+ * Host memory counters of one VkSystemAllocationScope. Internal bytes are the
+ * allocations the driver reports through the internal notification callbacks
+ * (e.g. executable memory for shaders), they never go through the allocator.
+ */
+struct VKHostAllocStats {
+    uint64_t allocationCount = 0;   // calls to pfnAllocation / growing pfnReallocation
+    uint64_t freeCount = 0;
+    uint64_t liveAllocations = 0;
+    uint64_t liveBytes = 0;
+    uint64_t peakBytes = 0;
+    uint64_t pooledAllocations = 0; // served from a size class arena
+    uint64_t internalBytes = 0;
+};
+
+/*
+ * VKHostAllocator is the VkAllocationCallbacks implementation behind
+ * VULKAN_CPU_ALLOCATOR.
+ *
+ * Every block starts with a 16 byte header holding the requested size, the
+ * scope and the size class, so pfnFree / pfnReallocation need no lookup.
+ *
+ * Allocations in the OBJECT and COMMAND scopes are small and frequent. COMMAND
+ * scope memory only lives for the duration of a Vulkan command, OBJECT scope
+ * memory as long as the Vulkan object it belongs to. Both are carved out of
+ * 64KB arenas split into power of two size classes and recycled through per
+ * class free lists, one set of arenas per scope, so long lived objects don't
+ * fragment the arenas of the per command churn. Larger
+ * or more aligned requests, and the CACHE / DEVICE / INSTANCE scopes, go to
+ * the system allocator. Arenas are only returned to the system on destroy().
+ *
+ * Counts and bytes are tracked per scope, logStats() prints them together with
+ * the churn since the previous logStats() call.
+ */
+class VKHostAllocator
+{
+    public:
+        static VKHostAllocator &get();
+        static const VkAllocationCallbacks *getCallbacks();
+
+        VKHostAllocStats getStats(VkSystemAllocationScope scope);
+        void logStats(const char *label);
+
+        // releases the arenas, only valid once every Vulkan object is destroyed.
+        void destroy();
+
+    private:
+        VKHostAllocator();
+        ~VKHostAllocator() {};
+
+        static const uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+        static const uint32_t SIZE_CLASS_COUNT = 7;     // 64 bytes .. 4KB blocks
+        static const size_t ARENA_SIZE = 64 * 1024;
+
+        struct FreeBlock {
+            FreeBlock *next;
+        };
+
+        struct Pool {
+            FreeBlock *freeLists[SIZE_CLASS_COUNT] = {};
+            std::vector<void *> arenas;
+        };
+
+        void *allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+        void *reallocate(void *original, size_t size, size_t alignment,
+                         VkSystemAllocationScope scope);
+        void free(void *memory);
+        void *allocateFromPool(Pool &pool, uint32_t sizeClass);
+
+        static void *VKAPI_PTR allocationCallback(void *pUserData, size_t size,
+                                                  size_t alignment,
+                                                  VkSystemAllocationScope scope);
+        static void *VKAPI_PTR reallocationCallback(void *pUserData, void *pOriginal,
+                                                    size_t size, size_t alignment,
+                                                    VkSystemAllocationScope scope);
+        static void VKAPI_PTR freeCallback(void *pUserData, void *pMemory);
+        static void VKAPI_PTR internalAllocationCallback(void *pUserData, size_t size,
+                                                         VkInternalAllocationType type,
+                                                         VkSystemAllocationScope scope);
+        static void VKAPI_PTR internalFreeCallback(void *pUserData, size_t size,
+                                                   VkInternalAllocationType type,
+                                                   VkSystemAllocationScope scope);
+
+        VkAllocationCallbacks callbacks;
+        Pool pools[SCOPE_COUNT];
+        VKHostAllocStats stats[SCOPE_COUNT];
+        VKHostAllocStats lastLogged[SCOPE_COUNT];
+        std::mutex mutex;
+};
@@ -0,0 +1,108 @@
+#include <assert.h>
+#include <string>
+
+#include "utils.h"
+#include "vk_init_graph.h"
+
+VKInitNode VKInitGraph::add(const char *name, std::function<void()> task,
+                            std::initializer_list<VKInitNode> dependencies)
+{
+    VKInitNode node = static_cast<VKInitNode>(nodes.size());
+
+    nodes.emplace_back();
+    Node &newNode = nodes.back();
+    newNode.name = name;
+    newNode.task = std::move(task);
+    for (VKInitNode dependency : dependencies) {
+        assert(dependency < node);  // depends on a node that was not added yet!
+        newNode.dependencies.push_back(dependency);
+        nodes[dependency].dependents.push_back(node);
+    }
+
+    return node;
+}
+
+void VKInitGraph::runNode(VKInitNode node, VKJobSystem &jobSystem, VKJobCounter &counter)
+{
+    Node &current = nodes[node];
+    current.startMs = std::chrono::duration<double, std::milli>(
+        Clock::now() - startTime).count();
+    current.task();
+    current.endMs = std::chrono::duration<double, std::milli>(
+        Clock::now() - startTime).count();
+
+    // the last dependency to finish starts the dependent. It is counted
+    // before this job finishes, so the counter can't reach zero early.
+    for (VKInitNode dependent : current.dependents) {
+        if (nodes[dependent].pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            jobSystem.run([this, dependent, &jobSystem, &counter] {
+                runNode(dependent, jobSystem, counter);
+            }, &counter);
+        }
+    }
+
+    return;
+}
+
+void VKInitGraph::run(VKJobSystem &jobSystem)
+{
+    startTime = Clock::now();
+
+    for (Node &node : nodes) {
+        node.pending = static_cast<uint32_t>(node.dependencies.size());
+    }
+
+    VKJobCounter counter;
+    for (VKInitNode node = 0; node < nodes.size(); node++) {
+        if (nodes[node].dependencies.empty()) {
+            jobSystem.run([this, node, &jobSystem, &counter] {
+                runNode(node, jobSystem, counter);
+            }, &counter);
+        }
+    }
+    jobSystem.wait(counter);
+
+    totalMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+
+    return;
+}
+
+void VKInitGraph::logReport() const
+{
+    if (nodes.empty()) {
+        return;
+    }
+
+    // nodes are in topological order, so one pass finds the longest chain.
+    std::vector<double> pathMs(nodes.size(), 0.0);
+    std::vector<int> previous(nodes.size(), -1);
+    double serialMs = 0.0;
+    VKInitNode last = 0;
+    for (VKInitNode node = 0; node < nodes.size(); node++) {
+        const Node &current = nodes[node];
+        double ms = current.endMs - current.startMs;
+        serialMs += ms;
+
+        for (VKInitNode dependency : current.dependencies) {
+            if (previous[node] < 0 || pathMs[dependency] > pathMs[previous[node]]) {
+                previous[node] = static_cast<int>(dependency);
+            }
+        }
+        pathMs[node] = ms + (previous[node] >= 0 ? pathMs[previous[node]] : 0.0);
+        if (pathMs[node] > pathMs[last]) {
+            last = node;
+        }
+
+        LOGI("init %-20s start %8.2f ms, took %8.2f ms", current.name, current.startMs, ms);
+    }
+
+    std::string criticalPath;
+    for (int node = static_cast<int>(last); node >= 0; node = previous[node]) {
+        criticalPath = nodes[node].name + (criticalPath.empty() ? "" : " -> " + criticalPath);
+    }
+
+    LOGI("init took %.2f ms, %.2f ms of work, critical path %.2f ms: %s",
+         totalMs, serialMs, pathMs[last], criticalPath.c_str());
+
+    return;
+}
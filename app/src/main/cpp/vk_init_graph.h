@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "vk_job_system.h"
+
+typedef uint32_t VKInitNode;
+
+/*
+ * VKInitGraph runs the steps of initVulkan() as a dependency graph on the
+ * VKJobSystem, so independent steps overlap: shader loading with instance
+ * and swapchain creation, mesh uploads with pipeline compilation.
+ *
+ * add() takes the nodes a step reads the results of. Dependencies can only
+ * name nodes added before, so the graph is acyclic by construction. run()
+ * starts every node once all of its dependencies finished and returns when
+ * the whole graph is done.
+ *
+ * Two nodes without a path between them may run at the same time, so
+ * anything they share must be thread safe or they need an edge anyway.
+ *
+ * logReport() prints when each node started and how long it took, and the
+ * critical path: the chain of dependencies with the largest total time,
+ * which bounds the startup time no matter how many cores there are.
+ */
+class VKInitGraph
+{
+    public:
+        VKInitGraph() {};
+        ~VKInitGraph() {};
+
+        VKInitNode add(const char *name, std::function<void()> task,
+                       std::initializer_list<VKInitNode> dependencies = {});
+
+        void run(VKJobSystem &jobSystem);
+        void logReport() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Node {
+            const char *name;
+            std::function<void()> task;
+            std::vector<VKInitNode> dependencies;
+            std::vector<VKInitNode> dependents;
+            std::atomic<uint32_t> pending{0};
+            // relative to the start of run().
+            double startMs = 0.0;
+            double endMs = 0.0;
+        };
+
+        void runNode(VKInitNode node, VKJobSystem &jobSystem, VKJobCounter &counter);
+
+        // a deque, nodes hold atomics and must not move.
+        std::deque<Node> nodes;
+        Clock::time_point startTime;
+        double totalMs = 0.0;
+};
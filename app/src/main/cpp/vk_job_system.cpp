@@ -0,0 +1,431 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <queue>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "utils.h"
+#include "vk_job_system.h"
+
+// the pool and deque index of the calling thread, -1 outside of any pool.
+static thread_local const VKJobSystem *currentJobSystem = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+void VKJobSystem::init(uint32_t workerCount, bool pinThreads)
+{
+    if (workerCount == 0) {
+        uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+        workerCount = std::max(cores - 1, 1u);
+    }
+
+    stopping = false;
+    queuedTasks = 0;
+    nextWorker = 0;
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers.push_back(new Worker());
+    }
+    // all deques exist before any worker may try to steal.
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers[i]->thread = std::thread(&VKJobSystem::workerMain, this, i, pinThreads);
+    }
+
+    LOGI("job system: %u workers%s", workerCount, pinThreads ? ", pinned" : "");
+
+    return;
+}
+
+void VKJobSystem::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (Worker *worker : workers) {
+        worker->thread.join();
+        assert(worker->tasks.empty());  // destroyed with jobs still queued!
+        delete worker;
+    }
+    workers.clear();
+
+    return;
+}
+
+void VKJobSystem::workerMain(uint32_t workerIndex, bool pinThread)
+{
+    currentJobSystem = this;
+    currentWorkerIndex = static_cast<int>(workerIndex);
+
+#if defined(__linux__)
+    if (pinThread) {
+        // core 0 is left to the render thread.
+        uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET((workerIndex + 1) % cores, &cpuSet);
+        if (sched_setaffinity(gettid(), sizeof(cpuSet), &cpuSet) != 0) {
+            LOGE("job system: failed to pin worker %u", workerIndex);
+        }
+    }
+#else
+    (void)pinThread;
+#endif
+
+    while (true) {
+        if (tryRunOne()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || queuedTasks.load() > 0; });
+        if (stopping && queuedTasks.load() <= 0) {
+            return;
+        }
+    }
+}
+
+void VKJobSystem::schedule(Task task)
+{
+    uint32_t workerIndex;
+    if (currentJobSystem == this) {
+        workerIndex = static_cast<uint32_t>(currentWorkerIndex);
+    } else {
+        workerIndex = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    }
+
+    Worker *worker = workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(std::move(task));
+    }
+
+    {
+        // under sleepMutex, so a worker can't miss it between its check and its wait.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks.fetch_add(1);
+    }
+    wakeUp.notify_one();
+
+    return;
+}
+
+void VKJobSystem::run(VKJob job, VKJobCounter *counter, VKJobCounter *dependency)
+{
+    if (counter != nullptr) {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->isDone()) {
+            // scheduled by finish() of the dependency's last job.
+            dependency->waiters.push_back({std::move(job), counter});
+            return;
+        }
+    }
+
+    schedule({std::move(job), counter});
+
+    return;
+}
+
+bool VKJobSystem::popOrSteal(Task &task)
+{
+    int own = currentJobSystem == this ? currentWorkerIndex : -1;
+    if (own >= 0) {
+        Worker *worker = workers[own];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty()) {
+            task = std::move(worker->tasks.back());
+            worker->tasks.pop_back();
+            return true;
+        }
+    }
+
+    // steal the oldest job, starting next to us so thieves spread out.
+    uint32_t count = static_cast<uint32_t>(workers.size());
+    uint32_t start = own >= 0 ? static_cast<uint32_t>(own) + 1 : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        Worker *victim = workers[(start + i) % count];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()) {
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool VKJobSystem::tryRunOne()
+{
+    if (queuedTasks.load(std::memory_order_acquire) <= 0) {
+        return false;
+    }
+
+    Task task;
+    if (!popOrSteal(task)) {
+        return false;
+    }
+    queuedTasks.fetch_sub(1);
+    execute(task);
+
+    return true;
+}
+
+void VKJobSystem::execute(Task &task)
+{
+    task.job();
+    finish(task.counter);
+
+    return;
+}
+
+void VKJobSystem::finish(VKJobCounter *counter)
+{
+    if (counter == nullptr) {
+        return;
+    }
+
+    uint32_t pending = counter->pending.load(std::memory_order_acquire);
+    while (pending > 1) {
+        if (counter->pending.compare_exchange_weak(pending, pending - 1,
+                                                   std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    // the last job: the counter becomes done and its waiters are taken in
+    // one step under the mutex. wait() takes the mutex before returning, so
+    // the owner can't destroy the counter while this still uses it.
+    std::vector<VKJobCounter::Waiter> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            released.swap(counter->waiters);
+        }
+    }
+    for (VKJobCounter::Waiter &waiter : released) {
+        schedule({std::move(waiter.job), waiter.counter});
+    }
+
+    return;
+}
+
+void VKJobSystem::wait(VKJobCounter &counter)
+{
+    while (!counter.isDone()) {
+        if (!tryRunOne()) {
+            std::this_thread::yield();
+        }
+    }
+    // finish() of the last job may still hold the mutex.
+    std::lock_guard<std::mutex> lock(counter.mutex);
+
+    return;
+}
+
+void VKJobSystem::parallelFor(uint32_t count, uint32_t grainSize,
+                              const std::function<void(uint32_t begin, uint32_t end)> &body)
+{
+    grainSize = std::max(grainSize, 1u);
+    if (count <= grainSize) {
+        if (count > 0) {
+            body(0, count);
+        }
+        return;
+    }
+
+    VKJobCounter counter;
+    // the first range runs on the calling thread.
+    for (uint32_t begin = grainSize; begin < count; begin += grainSize) {
+        uint32_t end = std::min(begin + grainSize, count);
+        run([&body, begin, end] { body(begin, end); }, &counter);
+    }
+    body(0, grainSize);
+    wait(counter);
+
+    return;
+}
+
+namespace {
+
+/*
+ * The baseline for benchmark(): one std::queue behind one mutex, shared by
+ * all threads.
+ */
+class MutexJobQueue
+{
+    public:
+        MutexJobQueue(uint32_t workerCount) {
+            for (uint32_t i = 0; i < workerCount; i++) {
+                threads.emplace_back([this] { workerMain(); });
+            }
+        }
+
+        ~MutexJobQueue() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+        }
+
+        void run(VKJob job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push(std::move(job));
+                pending++;
+            }
+            wakeUp.notify_one();
+        }
+
+        void waitIdle() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this] { return pending == 0; });
+        }
+
+    private:
+        void workerMain() {
+            while (true) {
+                VKJob job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeUp.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop();
+                }
+                job();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending--;
+                }
+                idle.notify_all();
+            }
+        }
+
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable idle;
+        std::queue<VKJob> jobs;
+        uint32_t pending = 0;
+        bool stopping = false;
+};
+
+}  // namespace
+
+void VKJobSystem::benchmark()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const uint32_t JOB_COUNT = 100000;
+    const uint32_t WORK_PER_JOB = 256;
+
+    std::atomic<uint64_t> sink{0};
+    auto work = [&sink] {
+        uint64_t value = 0;
+        for (uint32_t i = 0; i < WORK_PER_JOB; i++) {
+            value = value * 31 + i;
+        }
+        sink.fetch_add(value, std::memory_order_relaxed);
+    };
+
+    // jobs spawned from a job land in the spawning worker's deque.
+    auto start = Clock::now();
+    VKJobCounter counter;
+    run([this, &work, &counter] {
+        for (uint32_t i = 0; i < JOB_COUNT; i++) {
+            run(work, &counter);
+        }
+    }, &counter);
+    wait(counter);
+    double stealingMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    start = Clock::now();
+    {
+        MutexJobQueue queue(getWorkerCount());
+        for (uint32_t i = 0; i < JOB_COUNT; i++) {
+            queue.run(work);
+        }
+        queue.waitIdle();
+    }
+    double mutexMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    start = Clock::now();
+    parallelFor(JOB_COUNT, 1024, [&work](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            work();
+        }
+    });
+    double parallelForMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    LOGI("benchmark: %u jobs on %u workers, work stealing %.2f ms (%.0f jobs/ms), "
+         "mutex queue %.2f ms (%.0f jobs/ms), parallelFor %.2f ms",
+         JOB_COUNT, getWorkerCount(), stealingMs, JOB_COUNT / stealingMs,
+         mutexMs, JOB_COUNT / mutexMs, parallelForMs);
+
+    return;
+}
+
+bool VKJobSystem::testCounterLifetime()
+{
+    const uint32_t ENTRY_COUNT = 4096;
+    const uint8_t FREED = 0xdd;
+
+    // a registry entry: freed as soon as wait() on its counter returns.
+    struct Entry {
+        VKJobCounter compiling;
+        uint32_t pipeline = 0;
+    };
+    struct Storage {
+        alignas(Entry) uint8_t bytes[sizeof(Entry)];
+    };
+    // kept allocated, a freed entry is overwritten with FREED instead.
+    std::vector<Storage> storage(ENTRY_COUNT);
+
+    for (uint32_t i = 0; i < ENTRY_COUNT; i++) {
+        Entry *entry = new (storage[i].bytes) Entry();
+        // the compile and a second job, so the last one to finish is
+        // often a worker while this thread already waits.
+        run([entry, i] { entry->pipeline = i; }, &entry->compiling);
+        run([] {}, &entry->compiling);
+        wait(entry->compiling);
+        entry->~Entry();
+        memset(storage[i].bytes, FREED, sizeof(Entry));
+    }
+    // a job still touching its counter has long finished by now.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    uint32_t touched = 0;
+    for (const Storage &entry : storage) {
+        for (uint8_t byte : entry.bytes) {
+            if (byte != FREED) {
+                touched++;
+                break;
+            }
+        }
+    }
+    if (touched > 0) {
+        LOGE("test: %u of %u job counters were used after wait() returned",
+             touched, ENTRY_COUNT);
+        return false;
+    }
+    LOGI("test: %u job counters destroyed right after wait(), none used afterwards",
+         ENTRY_COUNT);
+
+    return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> VKJob;
+
+class VKJobSystem;
+
+/*
+ * Counts the unfinished jobs of a group. run() increments it, the end of
+ * each job decrements it. Jobs can be made to depend on a counter, they are
+ * only scheduled once it reached zero. A counter must outlive its jobs: it
+ * may be destroyed once VKJobSystem::wait() on it returned, not as soon as
+ * isDone() is true.
+ */
+class VKJobCounter
+{
+    public:
+        VKJobCounter() {};
+        ~VKJobCounter() {};
+
+        bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class VKJobSystem;
+
+        struct Waiter {
+            VKJob job;
+            VKJobCounter *counter;
+        };
+
+        std::atomic<uint32_t> pending{0};
+        std::mutex mutex;
+        // jobs depending on this counter.
+        std::vector<Waiter> waiters;
+};
+
+/*
+ * VKJobSystem is a work-stealing task scheduler.
+ *
+ * Every worker thread owns a deque: jobs run by a worker go to the back of
+ * its own deque and it pops from the back, so nested work stays hot in its
+ * cache. An idle worker steals from the front of the others. Jobs from
+ * threads outside the pool (the render thread) are spread round robin.
+ * Workers sleep on a condition variable when there is nothing to run.
+ *
+ * wait() does not block: the waiting thread runs queued jobs until the
+ * counter completes, so the render thread adds itself to the pool while it
+ * waits, and jobs may wait on sub jobs without deadlocking.
+ *
+ * Each deque has its own mutex; contention is limited to a thief and the
+ * owner hitting the same deque.
+ */
+class VKJobSystem
+{
+    public:
+        VKJobSystem() {};
+        ~VKJobSystem() {};
+
+        // workerCount 0 means one worker per core besides the calling
+        // thread. pinThreads binds worker i to core i + 1 (Linux only).
+        void init(uint32_t workerCount = 0, bool pinThreads = false);
+        void destroy();
+
+        uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+        // workers plus the thread calling wait().
+        uint32_t getThreadCount() const { return getWorkerCount() + 1; }
+
+        // counter, if any, is incremented now and decremented when job has
+        // run. With a dependency, job only starts once that counter is done.
+        void run(VKJob job, VKJobCounter *counter = nullptr,
+                 VKJobCounter *dependency = nullptr);
+        // runs jobs until counter is done, the counter is no longer used
+        // by the job system afterwards.
+        void wait(VKJobCounter &counter);
+
+        // calls body(begin, end) on ranges of at most grainSize items
+        // covering [0, count) and waits for all of them.
+        void parallelFor(uint32_t count, uint32_t grainSize,
+                         const std::function<void(uint32_t begin, uint32_t end)> &body);
+
+        // throughput of tiny jobs, against a single mutex protected queue.
+        void benchmark();
+        // destroys counters right after wait() while their last job
+        // finishes, as VKPipelineRegistry::destroy() does with its entries.
+        // false if the job system touched a destroyed counter.
+        bool testCounterLifetime();
+
+    private:
+        struct Task {
+            VKJob job;
+            VKJobCounter *counter;
+        };
+
+        struct Worker {
+            std::thread thread;
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void workerMain(uint32_t workerIndex, bool pinThread);
+        void schedule(Task task);
+        bool tryRunOne();
+        bool popOrSteal(Task &task);
+        void execute(Task &task);
+        void finish(VKJobCounter *counter);
+
+        std::vector<Worker *> workers;
+
+        std::mutex sleepMutex;
+        std::condition_variable wakeUp;
+        std::atomic<int32_t> queuedTasks{0};
+        std::atomic<uint32_t> nextWorker{0};
+        bool stopping = false;
+};
@@ -0,0 +1,196 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vk_layout_cache.h"
+
+void VKPipelineInterface::add(const VKShaderReflection &reflection)
+{
+    for (const VKDescriptorBinding &binding : reflection.bindings) {
+        auto it = std::lower_bound(bindings.begin(), bindings.end(), binding,
+            [](const VKDescriptorBinding &a, const VKDescriptorBinding &b) {
+                return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+            });
+        if (it != bindings.end() && it->set == binding.set && it->binding == binding.binding) {
+            // stages disagree on a binding!
+            assert(it->type == binding.type && it->count == binding.count);
+            it->stages |= binding.stages;
+        } else {
+            bindings.insert(it, binding);
+        }
+    }
+    if (reflection.pushConstantSize > 0) {
+        pushConstantSize = std::max(pushConstantSize, reflection.pushConstantSize);
+        pushConstantStages |= reflection.stage;
+    }
+
+    return;
+}
+
+uint32_t VKPipelineInterface::getSetCount() const
+{
+    return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+bool VKLayoutCache::SetLayoutKey::operator==(const SetLayoutKey &other) const
+{
+    if (bindings.size() != other.bindings.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < bindings.size(); i++) {
+        const VkDescriptorSetLayoutBinding &a = bindings[i];
+        const VkDescriptorSetLayoutBinding &b = other.bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+            a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t VKLayoutCache::SetLayoutKey::hash() const
+{
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    for (const VkDescriptorSetLayoutBinding &binding : bindings) {
+        hash = HashFNV1a(&binding.binding, sizeof(binding.binding), hash);
+        hash = HashFNV1a(&binding.descriptorType, sizeof(binding.descriptorType), hash);
+        hash = HashFNV1a(&binding.descriptorCount, sizeof(binding.descriptorCount), hash);
+        hash = HashFNV1a(&binding.stageFlags, sizeof(binding.stageFlags), hash);
+    }
+
+    return hash;
+}
+
+bool VKLayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey &other) const
+{
+    return setLayouts == other.setLayouts &&
+           pushConstants.stageFlags == other.pushConstants.stageFlags &&
+           pushConstants.offset == other.pushConstants.offset &&
+           pushConstants.size == other.pushConstants.size;
+}
+
+uint64_t VKLayoutCache::PipelineLayoutKey::hash() const
+{
+    uint64_t hash = HashFNV1a(setLayouts.data(),
+                              setLayouts.size() * sizeof(VkDescriptorSetLayout));
+    hash = HashFNV1a(&pushConstants.stageFlags, sizeof(pushConstants.stageFlags), hash);
+    hash = HashFNV1a(&pushConstants.offset, sizeof(pushConstants.offset), hash);
+
+    return HashFNV1a(&pushConstants.size, sizeof(pushConstants.size), hash);
+}
+
+void VKLayoutCache::init(VkDevice device)
+{
+    this->device = device;
+
+    return;
+}
+
+void VKLayoutCache::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &pipelineLayout : pipelineLayouts) {
+        vkDestroyPipelineLayout(device, pipelineLayout.second, VULKAN_CPU_ALLOCATOR);
+    }
+    pipelineLayouts.clear();
+    for (auto &setLayout : setLayouts) {
+        vkDestroyDescriptorSetLayout(device, setLayout.second, VULKAN_CPU_ALLOCATOR);
+    }
+    setLayouts.clear();
+    device = VK_NULL_HANDLE;
+
+    return;
+}
+
+VkDescriptorSetLayout VKLayoutCache::getSetLayout(const VKPipelineInterface &interface,
+                                                  uint32_t set)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    requests++;
+
+    return getSetLayoutLocked(interface, set);
+}
+
+VkDescriptorSetLayout VKLayoutCache::getSetLayoutLocked(const VKPipelineInterface &interface,
+                                                        uint32_t set)
+{
+    SetLayoutKey key;
+    for (const VKDescriptorBinding &binding : interface.bindings) {
+        if (binding.set != set) {
+            continue;
+        }
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.binding = binding.binding;
+        layoutBinding.descriptorType = binding.type;
+        if (interface.dynamicUniformBuffers &&
+            binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        }
+        layoutBinding.descriptorCount = binding.count;
+        layoutBinding.stageFlags = binding.stages;
+        layoutBinding.pImmutableSamplers = nullptr;
+        key.bindings.push_back(layoutBinding);
+    }
+
+    auto it = setLayouts.find(key);
+    if (it != setLayouts.end()) {
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(key.bindings.size());
+    layoutInfo.pBindings = key.bindings.data();
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, VULKAN_CPU_ALLOCATOR,
+                                         &setLayout));
+    setLayouts.emplace(std::move(key), setLayout);
+
+    return setLayout;
+}
+
+VkPipelineLayout VKLayoutCache::getPipelineLayout(const VKPipelineInterface &interface)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    requests++;
+
+    PipelineLayoutKey key;
+    for (uint32_t set = 0; set < interface.getSetCount(); set++) {
+        key.setLayouts.push_back(getSetLayoutLocked(interface, set));
+    }
+    if (interface.pushConstantSize > 0) {
+        key.pushConstants.stageFlags = interface.pushConstantStages;
+        key.pushConstants.offset = 0;
+        key.pushConstants.size = interface.pushConstantSize;
+    }
+
+    auto it = pipelineLayouts.find(key);
+    if (it != pipelineLayouts.end()) {
+        return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(key.setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = key.setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = interface.pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &key.pushConstants;
+
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, VULKAN_CPU_ALLOCATOR,
+                                    &pipelineLayout));
+    pipelineLayouts.emplace(std::move(key), pipelineLayout);
+
+    return pipelineLayout;
+}
+
+void VKLayoutCache::logStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    LOGI("layout cache: %u requests, %zu set layouts, %zu pipeline layouts",
+         requests, setLayouts.size(), pipelineLayouts.size());
+
+    return;
+}
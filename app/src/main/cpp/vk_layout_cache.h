@@ -0,0 +1,92 @@
+#pragma once
+
+#include "utils.h"
+#include "vk_shader_reflection.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * VKPipelineInterface is the union of the reflections of the shaders of a
+ * pipeline: a binding used by several stages is listed once with all of
+ * them, the push constant block covers the largest one.
+ *
+ * The samples bind every uniform buffer with a dynamic offset into the
+ * VKUniformRingBuffer, so with dynamicUniformBuffers the reflected
+ * VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER becomes UNIFORM_BUFFER_DYNAMIC.
+ */
+struct VKPipelineInterface {
+    // sorted by set and binding.
+    std::vector<VKDescriptorBinding> bindings;
+    uint32_t pushConstantSize = 0;
+    VkShaderStageFlags pushConstantStages = 0;
+    bool dynamicUniformBuffers = true;
+
+    // the stages must agree on the type and count of shared bindings.
+    void add(const VKShaderReflection &reflection);
+    // highest set used plus one.
+    uint32_t getSetCount() const;
+};
+
+/*
+ * VKLayoutCache owns the descriptor set layouts and pipeline layouts of the
+ * app, one per distinct content. Shaders with the same interface get the
+ * same VkDescriptorSetLayout and VkPipelineLayout, so their pipelines and
+ * descriptor sets stay compatible and nothing is created twice.
+ *
+ * Set layouts are keyed by their bindings, pipeline layouts by their set
+ * layouts and push constant range. Sets below the highest one a pipeline
+ * uses get an empty layout.
+ *
+ * Thread safe, objects live until destroy().
+ */
+class VKLayoutCache
+{
+    public:
+        VKLayoutCache() {};
+        ~VKLayoutCache() {};
+
+        void init(VkDevice device);
+        // no pipeline or descriptor set may use the layouts anymore.
+        void destroy();
+
+        VkDescriptorSetLayout getSetLayout(const VKPipelineInterface &interface, uint32_t set);
+        VkPipelineLayout getPipelineLayout(const VKPipelineInterface &interface);
+
+        void logStats();
+
+    private:
+        struct SetLayoutKey {
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+            bool operator==(const SetLayoutKey &other) const;
+            uint64_t hash() const;
+        };
+        struct PipelineLayoutKey {
+            std::vector<VkDescriptorSetLayout> setLayouts;
+            VkPushConstantRange pushConstants{};
+
+            bool operator==(const PipelineLayoutKey &other) const;
+            uint64_t hash() const;
+        };
+        template <typename Key>
+        struct KeyHash {
+            size_t operator()(const Key &key) const {
+                return static_cast<size_t>(key.hash());
+            }
+        };
+
+        // with the lock held.
+        VkDescriptorSetLayout getSetLayoutLocked(const VKPipelineInterface &interface,
+                                                 uint32_t set);
+
+        VkDevice device = VK_NULL_HANDLE;
+
+        std::mutex mutex;
+        std::unordered_map<SetLayoutKey, VkDescriptorSetLayout, KeyHash<SetLayoutKey>>
+            setLayouts;
+        std::unordered_map<PipelineLayoutKey, VkPipelineLayout, KeyHash<PipelineLayoutKey>>
+            pipelineLayouts;
+        uint32_t requests = 0;
+};
@@ -60,6 +60,8 @@ static void HandleCmd(struct android_app *app, int32_t cmd) {
     switch (cmd) {
       case APP_CMD_START:
           vkApp = CreateVKApp();
+          vkApp->setDataPath(app->activity->internalDataPath);
+          vkApp->setLooper(app->looper);
           if (engine->app->window != nullptr) {
               vkApp->reset(app->window, app->activity->assetManager);
               vkApp->initVulkan();
@@ -78,6 +80,22 @@ static void HandleCmd(struct android_app *app, int32_t cmd) {
               engine->canRender = true;
           }
           break;
+      case APP_CMD_WINDOW_REDRAW_NEEDED:
+      case APP_CMD_WINDOW_RESIZED:
+      case APP_CMD_CONFIG_CHANGED:
+      case APP_CMD_CONTENT_RECT_CHANGED:
+          // on a rotation the next present reports the swapchain as
+          // suboptimal and the app recreates it.
+          if (vkApp != nullptr) {
+              vkApp->invalidate();
+          }
+          break;
+      case APP_CMD_STOP:
+          // the process may be killed from here on without APP_CMD_DESTROY.
+          if (vkApp != nullptr) {
+              vkApp->savePipelineCache();
+          }
+          break;
       case APP_CMD_TERM_WINDOW:
           // The window is being hidden or closed, clean it up.
           engine->canRender = false;
@@ -115,6 +133,12 @@ static void HandleInputEvents(struct android_app *app) {
         return;
     }
 
+    // any touch or key may change what is on screen.
+    if (vkApp != nullptr &&
+        (inputBuf->motionEventsCount > 0 || inputBuf->keyEventsCount > 0)) {
+        vkApp->invalidate();
+    }
+
     // For the minimum, apps need to process the exit event (for example,
     // listening to AKEYCODE_BACK). This sample has done that in the Kotlin side
     // and not processing other input events, we just reset the event counter
@@ -142,16 +166,25 @@ void android_main(struct android_app *state) {
         int ident;
         int events;
         android_poll_source *source;
-        while ((ident = ALooper_pollAll(engine.canRender ? 0 : -1, nullptr, &events,
+        // block until the next event unless there is a frame to render.
+        bool renderNow = engine.canRender && vkApp->needsRender();
+        if (!renderNow && vkApp != nullptr) {
+            vkApp->onIdle();
+        }
+        while ((ident = ALooper_pollAll(renderNow ? 0 : -1, nullptr, &events,
                                         (void **)&source)) >= 0) {
             if (source != nullptr) {
               source->process(state, source);
             }
+            HandleInputEvents(state);
+            renderNow = engine.canRender && vkApp->needsRender();
         }
 
         HandleInputEvents(state);
 
-        vkApp->render();
+        if (engine.canRender && vkApp->needsRender()) {
+            vkApp->render();
+        }
     }
 }
 
@@ -163,5 +196,9 @@ VKBaseApp* CreateVKApp()
     // app = new VKColorApp();
     // app = new VKPointApp();
     app = new VKLineApp();
+    // 1 to MAX_FRAMES_IN_FLIGHT, can be changed again while rendering.
+    app->setFramesInFlight(2);
+    // LowLatency, PowerSaving or MaxThroughput, can be changed while rendering too.
+    app->setPresentGoal(VKPresentGoal::PowerSaving);
     return app;
 }
@@ -0,0 +1,335 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vk_memory_allocator.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void VKMemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                             VkDeviceSize preferredBlockSize)
+{
+    this->device = device;
+    this->preferredBlockSize = preferredBlockSize;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+    blocks.resize(memProperties.memoryTypeCount);
+
+    return;
+}
+
+void VKMemoryAllocator::destroy()
+{
+    logStats();
+
+    for (auto &typeBlocks : blocks) {
+        for (MemoryBlock *block : typeBlocks) {
+            if (block->allocationCount > 0) {
+                LOGE("memory block of type %u destroyed with %u live allocations",
+                     block->memoryTypeIndex, block->allocationCount);
+            }
+            destroyBlock(block);
+        }
+        typeBlocks.clear();
+    }
+    blocks.clear();
+
+    return;
+}
+
+/*
+ * Blocks are capped to 1/8 of their heap so small heaps (e.g. the 256MB
+ * DEVICE_LOCAL | HOST_VISIBLE heap on some desktop GPUs) are not exhausted
+ * by a single block.
+ */
+VkDeviceSize VKMemoryAllocator::getBlockSize(uint32_t memoryTypeIndex)
+{
+    uint32_t heapIndex = memProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize heapSize = memProperties.memoryHeaps[heapIndex].size;
+
+    return std::min(preferredBlockSize, std::max<VkDeviceSize>(heapSize / 8, 1));
+}
+
+VkResult VKMemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size,
+                                        bool dedicated, MemoryBlock *&block)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkResult result = vkAllocateMemory(device, &allocInfo, VULKAN_CPU_ALLOCATOR, &memory);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // host visible blocks stay mapped for their whole lifetime.
+    void *mappedData = nullptr;
+    VkMemoryPropertyFlags flags = memProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mappedData);
+        if (result != VK_SUCCESS) {
+            vkFreeMemory(device, memory, VULKAN_CPU_ALLOCATOR);
+            return result;
+        }
+    }
+
+    block = new MemoryBlock();
+    block->memory = memory;
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->mappedData = mappedData;
+    block->dedicated = dedicated;
+    block->freeList.push_back({0, size});
+
+    blocks[memoryTypeIndex].push_back(block);
+
+    return VK_SUCCESS;
+}
+
+void VKMemoryAllocator::destroyBlock(MemoryBlock *block)
+{
+    if (block->mappedData) {
+        vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, VULKAN_CPU_ALLOCATOR);
+    delete block;
+
+    return;
+}
+
+/*
+ * First-fit search over the sorted free-list. The chosen range is split into
+ * an optional padding range in front (created by alignment), the allocation
+ * itself, and an optional tail range.
+ */
+bool VKMemoryAllocator::allocateFromBlock(MemoryBlock *block, VkDeviceSize size,
+                                          VkDeviceSize alignment,
+                                          VKAllocation &allocation)
+{
+    for (size_t i = 0; i < block->freeList.size(); i++) {
+        FreeRange range = block->freeList[i];
+        VkDeviceSize alignedOffset = alignUp(range.offset, alignment);
+        if (alignedOffset + size > range.offset + range.size) {
+            continue;
+        }
+
+        VkDeviceSize padding = alignedOffset - range.offset;
+        VkDeviceSize tail = range.offset + range.size - (alignedOffset + size);
+
+        block->freeList.erase(block->freeList.begin() + i);
+        if (tail > 0) {
+            block->freeList.insert(block->freeList.begin() + i,
+                                   {alignedOffset + size, tail});
+        }
+        if (padding > 0) {
+            block->freeList.insert(block->freeList.begin() + i,
+                                   {range.offset, padding});
+        }
+
+        block->allocationCount++;
+        block->bytesInUse += size;
+
+        allocation.memory = block->memory;
+        allocation.offset = alignedOffset;
+        allocation.size = size;
+        allocation.memoryTypeIndex = block->memoryTypeIndex;
+        allocation.mappedData = block->mappedData
+            ? static_cast<uint8_t *>(block->mappedData) + alignedOffset
+            : nullptr;
+        allocation.block = block;
+
+        return true;
+    }
+
+    return false;
+}
+
+VkResult VKMemoryAllocator::allocate(const VkMemoryRequirements &memRequirements,
+                                     uint32_t memoryTypeIndex, VKAllocation &allocation,
+                                     bool dedicated)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    allocation = VKAllocation{};
+    assert(memoryTypeIndex < blocks.size());
+
+    VkDeviceSize size = memRequirements.size;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(memRequirements.alignment, 1);
+
+    // non coherent ranges are flushed in nonCoherentAtomSize units, keep
+    // neighbouring allocations out of each other's atoms.
+    VkMemoryPropertyFlags flags = memProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, nonCoherentAtomSize);
+        size = alignUp(size, nonCoherentAtomSize);
+    }
+
+    VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+    bool ownBlock = dedicated || size > blockSize / 2;
+
+    if (!ownBlock) {
+        for (MemoryBlock *block : blocks[memoryTypeIndex]) {
+            if (!block->dedicated &&
+                allocateFromBlock(block, size, alignment, allocation)) {
+                return VK_SUCCESS;
+            }
+        }
+    }
+
+    MemoryBlock *block = nullptr;
+    VkResult result = createBlock(memoryTypeIndex, ownBlock ? size : blockSize, ownBlock,
+                                  block);
+    if (result != VK_SUCCESS) {
+        LOGE("failed to allocate a %llu bytes block of memory type %u: %d",
+             (unsigned long long)(ownBlock ? size : blockSize), memoryTypeIndex, result);
+        return result;
+    }
+    bool allocated = allocateFromBlock(block, size, ownBlock ? 1 : alignment, allocation);
+    assert(allocated);
+    (void)allocated;
+
+    return VK_SUCCESS;
+}
+
+void VKMemoryAllocator::free(VKAllocation &allocation)
+{
+    if (allocation.block == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryBlock *block = static_cast<MemoryBlock *>(allocation.block);
+
+    block->allocationCount--;
+    block->bytesInUse -= allocation.size;
+
+    // insert the range back in offset order, then merge with its neighbours.
+    auto &freeList = block->freeList;
+    auto it = std::lower_bound(freeList.begin(), freeList.end(), allocation.offset,
+                               [](const FreeRange &range, VkDeviceSize offset) {
+                                   return range.offset < offset;
+                               });
+    it = freeList.insert(it, {allocation.offset, allocation.size});
+
+    auto next = it + 1;
+    if (next != freeList.end() && it->offset + it->size == next->offset) {
+        it->size += next->size;
+        freeList.erase(next);
+    }
+    if (it != freeList.begin()) {
+        auto prev = it - 1;
+        if (prev->offset + prev->size == it->offset) {
+            prev->size += it->size;
+            freeList.erase(it);
+        }
+    }
+
+    // dedicated blocks go away with their only allocation, regular blocks are
+    // released once a second empty block of the same type exists.
+    if (block->allocationCount == 0) {
+        auto &typeBlocks = blocks[block->memoryTypeIndex];
+        size_t emptyBlocks = 0;
+        for (MemoryBlock *b : typeBlocks) {
+            if (!b->dedicated && b->allocationCount == 0) {
+                emptyBlocks++;
+            }
+        }
+        if (block->dedicated || emptyBlocks > 1) {
+            typeBlocks.erase(std::find(typeBlocks.begin(), typeBlocks.end(), block));
+            destroyBlock(block);
+        }
+    }
+
+    allocation = VKAllocation{};
+
+    return;
+}
+
+void VKMemoryAllocator::flush(const VKAllocation &allocation, VkDeviceSize offset,
+                              VkDeviceSize size)
+{
+    VkMemoryPropertyFlags flags =
+        memProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+        return;
+    }
+
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation.size - offset;
+    }
+
+    // allocation offset and size are already atom aligned, see allocate().
+    VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+    VkDeviceSize end = std::min(alignUp(allocation.offset + offset + size, nonCoherentAtomSize),
+                                allocation.offset + allocation.size);
+
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+    VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+
+    return;
+}
+
+uint32_t VKMemoryAllocator::findMemoryType(uint32_t typeFilter,
+                                           VkMemoryPropertyFlags properties)
+{
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
+                                        properties) == properties) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+VKMemoryStats VKMemoryAllocator::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    VKMemoryStats stats{};
+
+    for (auto &typeBlocks : blocks) {
+        for (MemoryBlock *block : typeBlocks) {
+            stats.blockCount++;
+            stats.dedicatedBlockCount += block->dedicated ? 1 : 0;
+            stats.allocationCount += block->allocationCount;
+            stats.bytesAllocated += block->size;
+            stats.bytesInUse += block->bytesInUse;
+            for (const FreeRange &range : block->freeList) {
+                stats.bytesFree += range.size;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+            }
+        }
+    }
+
+    if (stats.bytesFree > 0) {
+        stats.fragmentation =
+            1.0f - (float)stats.largestFreeRange / (float)stats.bytesFree;
+    }
+
+    return stats;
+}
+
+void VKMemoryAllocator::logStats()
+{
+    VKMemoryStats stats = getStats();
+    LOGI("device memory: %u blocks (%u dedicated), %u allocations, "
+         "%llu/%llu bytes in use, largest free range %llu bytes, fragmentation %.2f",
+         stats.blockCount, stats.dedicatedBlockCount, stats.allocationCount,
+         (unsigned long long)stats.bytesInUse, (unsigned long long)stats.bytesAllocated,
+         (unsigned long long)stats.largestFreeRange, stats.fragmentation);
+
+    return;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "utils.h"
+
+#include <mutex>
+
+/*
+ * VKAllocation describes a range of device memory handed out by
+ * VKMemoryAllocator. Buffers are bound with
+ * vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset).
+ *
+ * mappedData is non-null for HOST_VISIBLE memory, the owning block is
+ * persistently mapped, so callers must never vkMapMemory allocation.memory
+ * themselves.
+ */
+struct VKAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    void *mappedData = nullptr;
+    void *block = nullptr;
+};
+
+struct VKMemoryStats {
+    uint32_t blockCount = 0;
+    uint32_t dedicatedBlockCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize bytesAllocated = 0;
+    VkDeviceSize bytesInUse = 0;
+    VkDeviceSize bytesFree = 0;
+    VkDeviceSize largestFreeRange = 0;
+    // 0.0 means all free memory is one contiguous range,
+    // close to 1.0 means free memory is scattered over many small ranges.
+    float fragmentation = 0.0f;
+};
+
+/*
+ * VKMemoryAllocator carves VkDeviceMemory allocations out of large
+ * per-memory-type blocks instead of calling vkAllocateMemory once per buffer.
+ *
+ * Drivers cap the number of live allocations
+ * (VkPhysicalDeviceLimits::maxMemoryAllocationCount, often 4096 on mobile),
+ * and every vkAllocateMemory is an expensive kernel round-trip.
+ *
+ * Each block keeps a free-list of ranges sorted by offset. Allocation is
+ * first-fit with alignment handling, freeing merges neighbouring ranges.
+ * Requests bigger than half a block get a dedicated block of their own.
+ *
+ * Only linear resources (buffers) share blocks. Optimal tiling images must be
+ * allocated with dedicated = true so bufferImageGranularity never matters.
+ */
+class VKMemoryAllocator
+{
+    public:
+        VKMemoryAllocator() {};
+        ~VKMemoryAllocator() {};
+
+        void init(VkPhysicalDevice physicalDevice, VkDevice device,
+                  VkDeviceSize preferredBlockSize = 16 * 1024 * 1024);
+        void destroy();
+
+        // returns the error of vkAllocateMemory or vkMapMemory when no block
+        // has room and a new one can't be created, allocation is left empty.
+        VkResult allocate(const VkMemoryRequirements &memRequirements,
+                          uint32_t memoryTypeIndex, VKAllocation &allocation,
+                          bool dedicated = false);
+        void free(VKAllocation &allocation);
+
+        void flush(const VKAllocation &allocation, VkDeviceSize offset = 0,
+                   VkDeviceSize size = VK_WHOLE_SIZE);
+
+        // returns UINT32_MAX when no memory type matches.
+        uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+        VKMemoryStats getStats();
+        void logStats();
+
+    private:
+        struct FreeRange {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+        };
+
+        struct MemoryBlock {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            uint32_t memoryTypeIndex = 0;
+            void *mappedData = nullptr;
+            bool dedicated = false;
+            uint32_t allocationCount = 0;
+            VkDeviceSize bytesInUse = 0;
+            std::vector<FreeRange> freeList;
+        };
+
+        VkResult createBlock(uint32_t memoryTypeIndex, VkDeviceSize size,
+                             bool dedicated, MemoryBlock *&block);
+        void destroyBlock(MemoryBlock *block);
+        bool allocateFromBlock(MemoryBlock *block, VkDeviceSize size,
+                               VkDeviceSize alignment, VKAllocation &allocation);
+        VkDeviceSize getBlockSize(uint32_t memoryTypeIndex);
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memProperties;
+        VkDeviceSize preferredBlockSize = 0;
+        VkDeviceSize nonCoherentAtomSize = 1;
+
+        std::vector<std::vector<MemoryBlock *>> blocks;
+        std::mutex mutex;
+};
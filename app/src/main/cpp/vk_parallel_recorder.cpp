@@ -0,0 +1,119 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vk_parallel_recorder.h"
+
+void VKParallelRecorder::init(VkDevice device, uint32_t queueFamilyIndex,
+                              VKJobSystem *jobSystem, uint32_t slotCount)
+{
+    this->device = device;
+    this->jobSystem = jobSystem;
+
+    shares.resize(std::min(jobSystem->getThreadCount(), MAX_SHARES));
+    for (Share &share : shares) {
+        share.commandPools.resize(slotCount);
+        share.commandBuffers.resize(slotCount);
+        for (VkCommandPool &commandPool : share.commandPools) {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            poolInfo.queueFamilyIndex = queueFamilyIndex;
+            VK_CHECK(vkCreateCommandPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR,
+                                         &commandPool));
+        }
+    }
+
+    LOGI("parallel recorder: %zu shares", shares.size());
+
+    return;
+}
+
+void VKParallelRecorder::destroy()
+{
+    // destroying a pool frees its command buffers.
+    for (Share &share : shares) {
+        for (VkCommandPool commandPool : share.commandPools) {
+            vkDestroyCommandPool(device, commandPool, VULKAN_CPU_ALLOCATOR);
+        }
+    }
+    shares.clear();
+
+    return;
+}
+
+void VKParallelRecorder::recordShare(uint32_t shareIndex, uint32_t shareCount,
+                                     uint32_t slot, uint32_t imageIndex,
+                                     const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                                     uint32_t drawCount, const RecordFunction &recordFunction)
+{
+    Share &share = shares[shareIndex];
+    share.recorded = VK_NULL_HANDLE;
+
+    uint32_t perShare = (drawCount + shareCount - 1) / shareCount;
+    uint32_t firstDraw = shareIndex * perShare;
+    if (firstDraw >= drawCount) {
+        return;
+    }
+    uint32_t shareDrawCount = std::min(perShare, drawCount - firstDraw);
+
+    std::vector<VkCommandBuffer> &imageBuffers = share.commandBuffers[slot];
+    if (imageIndex >= imageBuffers.size()) {
+        imageBuffers.resize(imageIndex + 1, VK_NULL_HANDLE);
+    }
+    VkCommandBuffer &commandBuffer = imageBuffers[imageIndex];
+    if (commandBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = share.commandPools[slot];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
+    } else {
+        VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    recordFunction(commandBuffer, firstDraw, shareDrawCount);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    share.recorded = commandBuffer;
+
+    return;
+}
+
+void VKParallelRecorder::record(VkCommandBuffer primary, uint32_t slot, uint32_t imageIndex,
+                                const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                                uint32_t drawCount, const RecordFunction &recordFunction,
+                                uint32_t maxShares)
+{
+    assert(slot < shares[0].commandPools.size());
+
+    uint32_t shareCount = (drawCount + MIN_DRAWS_PER_SHARE - 1) / MIN_DRAWS_PER_SHARE;
+    shareCount = std::min({shareCount, getShareCount(), maxShares});
+    shareCount = std::max(shareCount, 1u);
+
+    jobSystem->parallelFor(shareCount, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            recordShare(i, shareCount, slot, imageIndex, inheritanceInfo, drawCount,
+                        recordFunction);
+        }
+    });
+
+    // in draw order, so the result matches a single threaded recording.
+    VkCommandBuffer secondaries[MAX_SHARES];
+    uint32_t secondaryCount = 0;
+    for (uint32_t i = 0; i < shareCount; i++) {
+        if (shares[i].recorded != VK_NULL_HANDLE) {
+            secondaries[secondaryCount++] = shares[i].recorded;
+        }
+    }
+    if (secondaryCount > 0) {
+        vkCmdExecuteCommands(primary, secondaryCount, secondaries);
+    }
+
+    return;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "utils.h"
+#include "vk_job_system.h"
+
+#include <functional>
+#include <vector>
+
+/*
+ * VKParallelRecorder splits the draws of a render pass into shares recorded
+ * as jobs on the VKJobSystem.
+ *
+ * Every share owns one VkCommandPool per frame slot and records its draws
+ * into a secondary command buffer that inherits the render pass. A share
+ * runs on one thread at a time, so its pools need no locking whichever
+ * worker picks it up. The calling thread helps with the shares, then
+ * gathers them into the primary with vkCmdExecuteCommands.
+ *
+ * Secondary command buffers are kept per (frame slot, swapchain image),
+ * like the primaries of VKCommandBufferCache, so a cached primary never
+ * references secondaries that were re-recorded for another image. The frame
+ * slot must have been waited on before record().
+ *
+ * Dynamic state is not inherited: the record function sets viewport,
+ * scissor etc. in every secondary command buffer.
+ */
+class VKParallelRecorder
+{
+    public:
+        // records the draws [firstDraw, firstDraw + drawCount) into commandBuffer.
+        typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                                   uint32_t drawCount)> RecordFunction;
+
+        VKParallelRecorder() {};
+        ~VKParallelRecorder() {};
+
+        // one share per job system thread, at most MAX_SHARES.
+        void init(VkDevice device, uint32_t queueFamilyIndex, VKJobSystem *jobSystem,
+                  uint32_t slotCount);
+        void destroy();
+
+        uint32_t getShareCount() const { return static_cast<uint32_t>(shares.size()); }
+        // false when drawCount fits in one share, recording inline into the
+        // primary is cheaper than a secondary command buffer then.
+        static bool isWorthIt(uint32_t drawCount) { return drawCount > MIN_DRAWS_PER_SHARE; }
+
+        // primary must be inside a render pass begun with
+        // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Uses at most
+        // maxShares shares, and fewer for small draw counts.
+        void record(VkCommandBuffer primary, uint32_t slot, uint32_t imageIndex,
+                    const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                    uint32_t drawCount, const RecordFunction &recordFunction,
+                    uint32_t maxShares = UINT32_MAX);
+
+    private:
+        static constexpr uint32_t MAX_SHARES = 16;
+        // below this a share is not worth a job.
+        static constexpr uint32_t MIN_DRAWS_PER_SHARE = 64;
+
+        struct Share {
+            // per slot.
+            std::vector<VkCommandPool> commandPools;
+            // [slot][imageIndex].
+            std::vector<std::vector<VkCommandBuffer>> commandBuffers;
+            // the secondary recorded by the current record(), null for no draws.
+            VkCommandBuffer recorded = VK_NULL_HANDLE;
+        };
+
+        void recordShare(uint32_t shareIndex, uint32_t shareCount, uint32_t slot,
+                         uint32_t imageIndex,
+                         const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                         uint32_t drawCount, const RecordFunction &recordFunction);
+
+        VkDevice device = VK_NULL_HANDLE;
+        VKJobSystem *jobSystem = nullptr;
+        std::vector<Share> shares;
+};
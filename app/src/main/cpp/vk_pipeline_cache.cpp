@@ -0,0 +1,145 @@
+#include <string.h>
+#include <chrono>
+
+#include "vk_pipeline_cache.h"
+
+// VkPipelineCacheHeaderVersionOne: 4 uint32_t and the 16 byte uuid.
+static const size_t CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+bool VKPipelineCache::isCompatible(const std::vector<uint8_t> &data) const
+{
+    if (data.size() < CACHE_HEADER_SIZE) {
+        return false;
+    }
+
+    uint32_t header[4];
+    memcpy(header, data.data(), sizeof(header));
+    uint32_t headerSize = header[0];
+    uint32_t headerVersion = header[1];
+    uint32_t vendorID = header[2];
+    uint32_t deviceID = header[3];
+
+    return headerSize >= CACHE_HEADER_SIZE && headerSize <= data.size() &&
+           headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           vendorID == properties.vendorID && deviceID == properties.deviceID &&
+           memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void VKPipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                           const std::string &path)
+{
+    this->device = device;
+    this->path = path;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    std::vector<uint8_t> data;
+    if (!path.empty() && ReadFileToVector(path, data)) {
+        if (!isCompatible(data)) {
+            LOGI("pipeline cache: %s is from another device or driver, ignored",
+                 path.c_str());
+            data.clear();
+        }
+    }
+    warm = !data.empty();
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    VK_CHECK(vkCreatePipelineCache(device, &createInfo, VULKAN_CPU_ALLOCATOR,
+                                   &pipelineCache));
+
+    LOGI("pipeline cache: %s, %zu bytes loaded", warm ? "warm" : "cold", data.size());
+
+    pipelineCount = 0;
+    creationMs = 0.0;
+    unsavedCount = 0;
+
+    return;
+}
+
+void VKPipelineCache::destroy()
+{
+    if (pipelineCache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    save();
+    logStats();
+    vkDestroyPipelineCache(device, pipelineCache, VULKAN_CPU_ALLOCATOR);
+    pipelineCache = VK_NULL_HANDLE;
+
+    return;
+}
+
+void VKPipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo &createInfo,
+                                             VkPipeline *pipeline)
+{
+    VK_CHECK(tryCreateGraphicsPipeline(createInfo, pipeline));
+
+    return;
+}
+
+VkResult VKPipelineCache::tryCreateGraphicsPipeline(
+    const VkGraphicsPipelineCreateInfo &createInfo, VkPipeline *pipeline)
+{
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo,
+                                                VULKAN_CPU_ALLOCATOR, pipeline);
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pipelineCount++;
+    unsavedCount++;
+    creationMs += ms;
+
+    return result;
+}
+
+void VKPipelineCache::save()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (path.empty() || pipelineCache == VK_NULL_HANDLE || unsavedCount == 0) {
+            return;
+        }
+        unsavedCount = 0;
+    }
+
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+    std::vector<uint8_t> data(size);
+    // VK_INCOMPLETE if the cache grew in between, the data is still valid.
+    VkResult result = vkGetPipelineCacheData(device, pipelineCache, &size, data.data());
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+        LOGE("pipeline cache: vkGetPipelineCacheData failed: %d", result);
+        return;
+    }
+    data.resize(size);
+
+    if (!WriteFileAtomic(path, data)) {
+        LOGE("pipeline cache: failed to save %s", path.c_str());
+        return;
+    }
+
+    LOGI("pipeline cache: saved %zu bytes", data.size());
+
+    return;
+}
+
+void VKPipelineCache::logStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pipelineCount == 0) {
+        return;
+    }
+
+    LOGI("pipeline cache (%s): %u pipelines created in %.2f ms, %.2f ms each",
+         warm ? "warm" : "cold", pipelineCount, creationMs, creationMs / pipelineCount);
+
+    return;
+}
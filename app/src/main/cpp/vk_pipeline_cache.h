@@ -0,0 +1,65 @@
+#pragma once
+
+#include "utils.h"
+
+#include <mutex>
+#include <string>
+
+/*
+ * VKPipelineCache is the one VkPipelineCache shared by every pipeline of the
+ * app, persisted in the app's internal storage so shaders compiled on one
+ * launch are not compiled again on the next.
+ *
+ * init() loads the file and only hands it to the driver when the header
+ * matches this device: header size and version, vendor id, device id and
+ * pipelineCacheUUID (which changes with the driver build). Anything else,
+ * a missing, truncated or stale file, starts with an empty cache.
+ *
+ * save() writes the cache data to a temporary file and renames it over the
+ * old one, so a process killed mid-write never leaves a torn cache behind.
+ * It is skipped when no pipeline was created since the last save. The app
+ * saves when it is stopped, Android may kill it afterwards, and on destroy().
+ *
+ * createGraphicsPipeline() times every creation, logStats() reports the
+ * totals for a cold (empty) or warm (loaded) cache.
+ */
+class VKPipelineCache
+{
+    public:
+        VKPipelineCache() {};
+        ~VKPipelineCache() {};
+
+        // path empty: an in-memory cache that is never saved.
+        void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path);
+        // saves, then destroys the cache.
+        void destroy();
+
+        VkPipelineCache get() const { return pipelineCache; }
+        bool isWarm() const { return warm; }
+
+        // thread safe, like vkCreateGraphicsPipelines on one cache.
+        void createGraphicsPipeline(const VkGraphicsPipelineCreateInfo &createInfo,
+                                    VkPipeline *pipeline);
+        // for createInfo with VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT,
+        // returns VK_PIPELINE_COMPILE_REQUIRED instead of aborting on a miss.
+        VkResult tryCreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo &createInfo,
+                                           VkPipeline *pipeline);
+
+        void save();
+        void logStats();
+
+    private:
+        bool isCompatible(const std::vector<uint8_t> &data) const;
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+        VkPhysicalDeviceProperties properties{};
+        std::string path;
+        bool warm = false;
+
+        std::mutex mutex;
+        uint32_t pipelineCount = 0;
+        double creationMs = 0.0;
+        // pipelines created since the last save().
+        uint32_t unsavedCount = 0;
+};
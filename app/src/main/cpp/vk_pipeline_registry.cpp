@@ -0,0 +1,474 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vk_pipeline_registry.h"
+
+static bool sameString(const char *a, const char *b)
+{
+    return a == b || (a != nullptr && b != nullptr && strcmp(a, b) == 0);
+}
+
+static uint64_t hashString(const char *string, uint64_t hash)
+{
+    return string != nullptr ? HashFNV1a(string, strlen(string), hash) : hash;
+}
+
+template <typename T>
+static uint64_t hashValue(const T &value, uint64_t hash)
+{
+    return HashFNV1a(&value, sizeof(value), hash);
+}
+
+bool VKPipelineState::operator==(const VKPipelineState &other) const
+{
+    return sameString(vertexShader, other.vertexShader) &&
+           sameString(fragmentShader, other.fragmentShader) &&
+           specialization == other.specialization &&
+           topology == other.topology &&
+           polygonMode == other.polygonMode &&
+           cullMode == other.cullMode &&
+           frontFace == other.frontFace &&
+           lineWidth == other.lineWidth &&
+           dynamicLineWidth == other.dynamicLineWidth &&
+           dynamicTopology == other.dynamicTopology &&
+           depthTest == other.depthTest &&
+           depthWrite == other.depthWrite &&
+           depthCompareOp == other.depthCompareOp &&
+           blendEnable == other.blendEnable &&
+           layout == other.layout &&
+           renderPass == other.renderPass &&
+           subpass == other.subpass;
+}
+
+// field by field, the padding between them is not initialized.
+uint64_t VKPipelineState::hash() const
+{
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    hash = hashString(vertexShader, hash);
+    hash = hashString(fragmentShader, hash);
+    hash = specialization.hash(hash);
+    hash = hashValue(topology, hash);
+    hash = hashValue(polygonMode, hash);
+    hash = hashValue(cullMode, hash);
+    hash = hashValue(frontFace, hash);
+    hash = hashValue(lineWidth, hash);
+    hash = hashValue(dynamicLineWidth, hash);
+    hash = hashValue(dynamicTopology, hash);
+    hash = hashValue(depthTest, hash);
+    hash = hashValue(depthWrite, hash);
+    hash = hashValue(depthCompareOp, hash);
+    hash = hashValue(blendEnable, hash);
+    hash = hashValue(layout, hash);
+    hash = hashValue(renderPass, hash);
+    hash = hashValue(subpass, hash);
+
+    return hash;
+}
+
+void VKPipelineRegistry::init(VkDevice device, VKPipelineCache *pipelineCache,
+                              VKShaderCache *shaderCache, VKJobSystem *jobSystem,
+                              const VKDynamicState *dynamicState,
+                              std::function<void()> onReady)
+{
+    this->device = device;
+    this->pipelineCache = pipelineCache;
+    this->shaderCache = shaderCache;
+    this->jobSystem = jobSystem;
+    this->dynamicState = dynamicState;
+    this->onReady = onReady;
+    requests = 0;
+    stalls = 0;
+    compiled = 0;
+    identifierHits = 0;
+    identifierMisses = 0;
+    totalLatencyMs = 0.0;
+    maxLatencyMs = 0.0;
+
+    return;
+}
+
+void VKPipelineRegistry::destroy()
+{
+    // once wait() returned the job system no longer uses entry->compiling,
+    // the entry can be deleted, see VKJobSystem::testCounterLifetime().
+    for (Entry *entry : entries) {
+        jobSystem->wait(entry->compiling);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Entry *entry : entries) {
+        // retired pipelines belong to the deletion queue.
+        if (!entry->retired) {
+            vkDestroyPipeline(device, entry->pipeline, VULKAN_CPU_ALLOCATOR);
+        }
+        delete entry;
+    }
+    entries.clear();
+    handles.clear();
+
+    return;
+}
+
+VKPipelineRegistry::Entry *VKPipelineRegistry::getEntry(VKPipelineHandle handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(handle < entries.size());  // invalid pipeline handle!
+
+    return entries[handle];
+}
+
+VKPipelineState VKPipelineRegistry::getSharedState(const VKPipelineState &state) const
+{
+    if (!state.dynamicTopology) {
+        return state;
+    }
+    assert(dynamicState->isEnabled());  // dynamic topology without the extension!
+
+    VKPipelineState shared = state;
+    shared.topology = dynamicState->getPipelineTopology(state.topology);
+    shared.cullMode = VK_CULL_MODE_NONE;
+    shared.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    shared.lineWidth = 1.0f;
+    shared.dynamicLineWidth = true;
+
+    return shared;
+}
+
+VKPipelineHandle VKPipelineRegistry::request(const VKPipelineState &requestedState,
+                                             VKPipelineHandle fallback)
+{
+    VKPipelineState state = getSharedState(requestedState);
+    Entry *entry;
+    VKPipelineHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests++;
+        auto it = handles.find(state);
+        if (it != handles.end()) {
+            return it->second;
+        }
+
+        handle = static_cast<VKPipelineHandle>(entries.size());
+        entry = new Entry();
+        entry->state = state;
+        entry->fallback = fallback;
+        entry->requestTime = Clock::now();
+        entries.push_back(entry);
+        handles.emplace(state, handle);
+    }
+
+    jobSystem->run([this, entry] { compile(entry); }, &entry->compiling);
+
+    return handle;
+}
+
+void VKPipelineRegistry::compile(Entry *entry)
+{
+    entry->pipeline = create(entry->state);
+    entry->ready.store(true, std::memory_order_release);
+
+    double latencyMs = std::chrono::duration<double, std::milli>(
+        Clock::now() - entry->requestTime).count();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compiled++;
+        totalLatencyMs += latencyMs;
+        maxLatencyMs = std::max(maxLatencyMs, latencyMs);
+    }
+
+    if (onReady) {
+        onReady();
+    }
+
+    return;
+}
+
+VkPipeline VKPipelineRegistry::resolve(VKPipelineHandle handle)
+{
+    if (handle == INVALID_PIPELINE_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+
+    Entry *entry = getEntry(handle);
+    if (entry->ready.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entry->retired ? VK_NULL_HANDLE : entry->pipeline;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stalls++;
+    }
+    if (entry->fallback != INVALID_PIPELINE_HANDLE && isReady(entry->fallback)) {
+        return resolve(entry->fallback);
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+bool VKPipelineRegistry::isReady(VKPipelineHandle handle)
+{
+    return handle != INVALID_PIPELINE_HANDLE &&
+           getEntry(handle)->ready.load(std::memory_order_acquire);
+}
+
+void VKPipelineRegistry::wait(VKPipelineHandle handle)
+{
+    if (handle != INVALID_PIPELINE_HANDLE) {
+        jobSystem->wait(getEntry(handle)->compiling);
+    }
+
+    return;
+}
+
+VkPipeline VKPipelineRegistry::get(const VKPipelineState &state)
+{
+    VKPipelineHandle handle = request(state);
+    wait(handle);
+
+    return resolve(handle);
+}
+
+void VKPipelineRegistry::retire(VkRenderPass renderPass, VKDeletionQueue &deletionQueue,
+                                uint64_t retireValue)
+{
+    std::vector<Entry *> retired;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Entry *entry : entries) {
+            if (!entry->retired && entry->state.renderPass == renderPass) {
+                entry->retired = true;
+                handles.erase(entry->state);
+                retired.push_back(entry);
+            }
+        }
+    }
+
+    // a compile still running references the render pass, it must finish
+    // before the render pass can be destroyed.
+    VkDevice device = this->device;
+    for (Entry *entry : retired) {
+        jobSystem->wait(entry->compiling);
+        VkPipeline pipeline = entry->pipeline;
+        deletionQueue.push(retireValue, [device, pipeline]() {
+            vkDestroyPipeline(device, pipeline, VULKAN_CPU_ALLOCATOR);
+        });
+    }
+
+    return;
+}
+
+uint32_t VKPipelineRegistry::getPipelineCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return static_cast<uint32_t>(handles.size());
+}
+
+void VKPipelineRegistry::logStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    LOGI("pipeline registry: %zu pipelines, %u requests, %u compiled in %.2f ms avg "
+         "(%.2f max) from request to ready, %u stalls, %u/%u created from identifiers",
+         handles.size(), requests, compiled, compiled > 0 ? totalLatencyMs / compiled : 0.0,
+         maxLatencyMs, stalls, identifierHits, identifierHits + identifierMisses);
+
+    return;
+}
+
+VkPipeline VKPipelineRegistry::createFromIdentifiers(
+    const VKPipelineState &state, VkGraphicsPipelineCreateInfo pipelineInfo,
+    const VkSpecializationInfo *specializationInfo)
+{
+#ifdef VK_EXT_shader_module_identifier
+    // a cold cache can't have the pipeline.
+    VKShaderIdentifier identifiers[2];
+    if (!pipelineCache->isWarm() ||
+        !shaderCache->getIdentifier(state.vertexShader, identifiers[0]) ||
+        !shaderCache->getIdentifier(state.fragmentShader, identifiers[1])) {
+        return VK_NULL_HANDLE;
+    }
+
+    VkPipelineShaderStageModuleIdentifierCreateInfoEXT identifierInfos[2] = {};
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        identifierInfos[i].sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+        identifierInfos[i].identifierSize = identifiers[i].size;
+        identifierInfos[i].pIdentifier = identifiers[i].data;
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].pNext = &identifierInfos[i];
+        shaderStages[i].module = VK_NULL_HANDLE;
+        shaderStages[i].pName = "main";
+        shaderStages[i].pSpecializationInfo = specializationInfo;
+    }
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.flags |= VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult result = pipelineCache->tryCreateGraphicsPipeline(pipelineInfo, &pipeline);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (result == VK_SUCCESS) {
+        identifierHits++;
+        return pipeline;
+    }
+    // VK_PIPELINE_COMPILE_REQUIRED, anything else fails again with the SPIR-V.
+    identifierMisses++;
+#else
+    (void)state;
+    (void)pipelineInfo;
+    (void)specializationInfo;
+#endif
+
+    return VK_NULL_HANDLE;
+}
+
+VkPipeline VKPipelineRegistry::create(const VKPipelineState &state)
+{
+    assert(state.vertexShader != nullptr && state.fragmentShader != nullptr);
+
+    // the vertex buffer layout is whatever the vertex shader reads, packed
+    // in location order into binding 0.
+    VKShaderReflection vertexReflection = shaderCache->getReflection(state.vertexShader);
+    std::vector<VkVertexInputAttributeDescription> vertexInputAttributes(
+        vertexReflection.vertexInputs.size());
+    VkVertexInputBindingDescription vertexInputBinding{};
+    vertexInputBinding.binding = 0;
+    vertexInputBinding.stride = vertexReflection.getVertexInput(vertexInputAttributes.data());
+    vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    if (!vertexInputAttributes.empty()) {
+        // the meshes of the samples are all Vertex.
+        assert(vertexInputBinding.stride == sizeof(Vertex));
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &vertexInputBinding;
+        vertexInputInfo.vertexAttributeDescriptionCount =
+            static_cast<uint32_t>(vertexInputAttributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = vertexInputAttributes.data();
+    }
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = state.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = state.polygonMode;
+    rasterizer.lineWidth = state.lineWidth;
+    rasterizer.cullMode = state.cullMode;
+    rasterizer.frontFace = state.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[7] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    uint32_t dynamicStateCount = 2;
+    if (state.dynamicLineWidth) {
+        dynamicStates[dynamicStateCount++] = VK_DYNAMIC_STATE_LINE_WIDTH;
+    }
+    if (state.dynamicTopology) {
+        dynamicStates[dynamicStateCount++] = VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT;
+        dynamicStates[dynamicStateCount++] = VK_DYNAMIC_STATE_CULL_MODE_EXT;
+        dynamicStates[dynamicStateCount++] = VK_DYNAMIC_STATE_FRONT_FACE_EXT;
+        if (dynamicState->hasPrimitiveRestart()) {
+            dynamicStates[dynamicStateCount++] = VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT;
+        }
+    }
+    VkPipelineDynamicStateCreateInfo dynamicStateCI{};
+    dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCI.pDynamicStates = dynamicStates;
+    dynamicStateCI.dynamicStateCount = dynamicStateCount;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = state.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = state.depthCompareOp;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    // render passes without a depth attachment ignore it.
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicStateCI;
+    pipelineInfo.layout = state.layout;
+    pipelineInfo.renderPass = state.renderPass;
+    pipelineInfo.subpass = state.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkSpecializationMapEntry specializationEntries[VKSpecialization::MAX_CONSTANTS];
+    VkSpecializationInfo specializationInfo{};
+    state.specialization.getInfo(specializationInfo, specializationEntries);
+    const VkSpecializationInfo *specialization =
+        state.specialization.getCount() > 0 ? &specializationInfo : nullptr;
+
+    VkPipeline pipeline = createFromIdentifiers(state, pipelineInfo, specialization);
+    if (pipeline != VK_NULL_HANDLE) {
+        return pipeline;
+    }
+
+    // the modules are owned by the shader cache.
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = shaderCache->getModule(state.vertexShader);
+    shaderStages[0].pName = "main";
+    shaderStages[0].pSpecializationInfo = specialization;
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = shaderCache->getModule(state.fragmentShader);
+    shaderStages[1].pName = "main";
+    shaderStages[1].pSpecializationInfo = specialization;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+
+    pipelineCache->createGraphicsPipeline(pipelineInfo, &pipeline);
+
+    return pipeline;
+}
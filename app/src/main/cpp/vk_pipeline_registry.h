@@ -0,0 +1,170 @@
+#pragma once
+
+#include "utils.h"
+#include "vk_pipeline_cache.h"
+#include "vk_job_system.h"
+#include "vk_deletion_queue.h"
+#include "vk_dynamic_state.h"
+#include "vk_shader_cache.h"
+#include "vk_specialization.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * VKPipelineState is everything that tells two graphics pipelines of the
+ * samples apart. The rest of the fixed function state is the same for all
+ * of them and filled in by VKPipelineRegistry. Viewport and scissor are
+ * always dynamic.
+ *
+ * The shaders are asset paths, compared by content. The vertex input comes
+ * from their reflection. layout and renderPass are part of the state as a
+ * pipeline is only valid with them.
+ */
+struct VKPipelineState {
+    const char *vertexShader = nullptr;
+    const char *fragmentShader = nullptr;
+    // specialization constants of both shaders, each set of values is its
+    // own variant of the pipeline.
+    VKSpecialization specialization;
+
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    float lineWidth = 1.0f;
+    // vkCmdSetLineWidth() instead of lineWidth.
+    bool dynamicLineWidth = false;
+    // topology, cull mode, front face and line width are recorded with
+    // VKDynamicState::record(), all states that only differ in them share
+    // one pipeline. Needs VKDynamicState::isEnabled().
+    bool dynamicTopology = false;
+
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    // src alpha over one minus src alpha.
+    bool blendEnable = false;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    bool operator==(const VKPipelineState &other) const;
+    bool operator!=(const VKPipelineState &other) const { return !(*this == other); }
+    uint64_t hash() const;
+};
+
+struct VKPipelineStateHash {
+    size_t operator()(const VKPipelineState &state) const {
+        return static_cast<size_t>(state.hash());
+    }
+};
+
+typedef uint32_t VKPipelineHandle;
+const VKPipelineHandle INVALID_PIPELINE_HANDLE = UINT32_MAX;
+
+/*
+ * VKPipelineRegistry owns the graphics pipelines of the app, one per unique
+ * VKPipelineState. Asking for the same material/topology combination again
+ * is a hash lookup, only the first request compiles.
+ *
+ * request() never blocks: it returns a handle and compiles the pipeline as
+ * a job on the VKJobSystem. resolve() returns VK_NULL_HANDLE until the
+ * compile is done, or the pipeline of the fallback handle given to request()
+ * if that one is ready, so the caller skips the draws (or draws with the
+ * fallback) instead of hitching the frame. Every such frame counts as a
+ * stall, logStats() reports them with the request to ready latencies.
+ *
+ * With VKPipelineState::dynamicTopology set, states are first reduced to
+ * the state of the pipeline they share, see getSharedState().
+ *
+ * Pipelines are only compatible with the render pass they were created for.
+ * When the render pass is recreated, retire() drops every pipeline built
+ * for the old one. Their handles resolve to VK_NULL_HANDLE from then on, the
+ * app requests its states again with the new render pass.
+ *
+ * Shader modules come from the VKShaderCache. When it has identifiers for
+ * both shaders and the pipeline cache is warm, the pipeline is first created
+ * from the identifiers alone, which fails instead of compiling on a cache
+ * miss. Only then are the modules created from SPIR-V.
+ *
+ * Thread safe. Pipelines are created through the shared VKPipelineCache.
+ */
+class VKPipelineRegistry
+{
+    public:
+        VKPipelineRegistry() {};
+        ~VKPipelineRegistry() {};
+
+        // onReady is called on the compiling thread every time a pipeline
+        // becomes ready, e.g. to wake a render loop that skipped its draws.
+        void init(VkDevice device, VKPipelineCache *pipelineCache, VKShaderCache *shaderCache,
+                  VKJobSystem *jobSystem, const VKDynamicState *dynamicState,
+                  std::function<void()> onReady = nullptr);
+        // waits for the compiles and destroys every pipeline, the device must be idle.
+        void destroy();
+
+        VKPipelineHandle request(const VKPipelineState &state,
+                                 VKPipelineHandle fallback = INVALID_PIPELINE_HANDLE);
+        // the pipeline, the fallback while it compiles or VK_NULL_HANDLE.
+        VkPipeline resolve(VKPipelineHandle handle);
+        bool isReady(VKPipelineHandle handle);
+        // helps compiling until handle is ready.
+        void wait(VKPipelineHandle handle);
+        // request() and wait(), for callers that can't draw without it.
+        VkPipeline get(const VKPipelineState &state);
+
+        // the pipelines of renderPass are destroyed once retireValue completed.
+        void retire(VkRenderPass renderPass, VKDeletionQueue &deletionQueue,
+                    uint64_t retireValue);
+
+        uint32_t getPipelineCount();
+        void logStats();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Entry {
+            VKPipelineState state;
+            VKPipelineHandle fallback = INVALID_PIPELINE_HANDLE;
+            // written by the compile job before ready is set.
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            std::atomic<bool> ready{false};
+            bool retired = false;
+            VKJobCounter compiling;
+            Clock::time_point requestTime;
+        };
+
+        // state with everything set dynamically replaced by fixed values.
+        VKPipelineState getSharedState(const VKPipelineState &state) const;
+        Entry *getEntry(VKPipelineHandle handle);
+        void compile(Entry *entry);
+        VkPipeline create(const VKPipelineState &state);
+        // VK_NULL_HANDLE if the identifiers are unknown or the pipeline cache misses.
+        VkPipeline createFromIdentifiers(const VKPipelineState &state,
+                                         VkGraphicsPipelineCreateInfo pipelineInfo,
+                                         const VkSpecializationInfo *specializationInfo);
+
+        VkDevice device = VK_NULL_HANDLE;
+        VKPipelineCache *pipelineCache = nullptr;
+        VKShaderCache *shaderCache = nullptr;
+        VKJobSystem *jobSystem = nullptr;
+        const VKDynamicState *dynamicState = nullptr;
+        std::function<void()> onReady;
+
+        std::mutex mutex;
+        // indexed by handle, entries are never removed before destroy().
+        std::vector<Entry *> entries;
+        std::unordered_map<VKPipelineState, VKPipelineHandle, VKPipelineStateHash> handles;
+        uint32_t requests = 0;
+        uint32_t stalls = 0;
+        uint32_t compiled = 0;
+        uint32_t identifierHits = 0;
+        uint32_t identifierMisses = 0;
+        double totalLatencyMs = 0.0;
+        double maxLatencyMs = 0.0;
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+
+#include "vk_present_policy.h"
+
+VKPresentConfig VKPresentPolicy::choose(VKPresentGoal goal,
+                                        const SwapChainSupportDetails &support)
+{
+    auto isSupported = [&support](VkPresentModeKHR mode) {
+        return std::find(support.presentModes.begin(), support.presentModes.end(), mode) !=
+               support.presentModes.end();
+    };
+
+    // in order of preference, FIFO is always there.
+    VkPresentModeKHR preferred[3] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR,
+                                     VK_PRESENT_MODE_FIFO_KHR};
+    uint32_t extraImages = 0;
+    switch (goal) {
+        case VKPresentGoal::LowLatency:
+            preferred[0] = VK_PRESENT_MODE_MAILBOX_KHR;
+            preferred[1] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            preferred[2] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            break;
+        case VKPresentGoal::PowerSaving:
+            break;
+        case VKPresentGoal::MaxThroughput:
+            preferred[0] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            preferred[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+            preferred[2] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            extraImages = 1;
+            break;
+    }
+
+    VKPresentConfig config{VK_PRESENT_MODE_FIFO_KHR, 0};
+    for (VkPresentModeKHR mode : preferred) {
+        if (isSupported(mode)) {
+            config.presentMode = mode;
+            break;
+        }
+    }
+
+    // MAILBOX only replaces queued frames when there is a spare image, with
+    // FIFO every extra image is one more frame of latency.
+    if (config.presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        extraImages++;
+    }
+    config.imageCount = support.capabilities.minImageCount + extraImages;
+    if (support.capabilities.maxImageCount > 0) {
+        config.imageCount = std::min(config.imageCount, support.capabilities.maxImageCount);
+    }
+
+    if (chosen && config.presentMode != presentMode) {
+        logStats();
+    }
+    LOGI("present policy %s: %s, %u images", getGoalName(goal),
+         getModeName(config.presentMode), config.imageCount);
+
+    this->goal = goal;
+    presentMode = config.presentMode;
+    chosen = true;
+    inFrame = false;
+
+    return config;
+}
+
+void VKPresentPolicy::beginFrame()
+{
+    acquireTime = Clock::now();
+    inFrame = true;
+
+    return;
+}
+
+void VKPresentPolicy::endFrame()
+{
+    if (!inFrame || presentMode >= MODE_COUNT) {
+        return;
+    }
+    inFrame = false;
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - acquireTime).count();
+    ModeStats &modeStats = stats[presentMode];
+    modeStats.frames++;
+    modeStats.totalMs += ms;
+    modeStats.maxMs = std::max(modeStats.maxMs, ms);
+
+    return;
+}
+
+void VKPresentPolicy::logStats()
+{
+    for (uint32_t i = 0; i < MODE_COUNT; i++) {
+        if (stats[i].frames == 0) {
+            continue;
+        }
+        LOGI("%s: acquire to present %.2f ms avg (%.2f max) over %u frames",
+             getModeName(static_cast<VkPresentModeKHR>(i)),
+             stats[i].totalMs / stats[i].frames, stats[i].maxMs, stats[i].frames);
+    }
+
+    return;
+}
+
+const char *VKPresentPolicy::getModeName(VkPresentModeKHR presentMode)
+{
+    switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "FIFO_RELAXED";
+        default:
+            return "unknown";
+    }
+}
+
+const char *VKPresentPolicy::getGoalName(VKPresentGoal goal)
+{
+    switch (goal) {
+        case VKPresentGoal::LowLatency:
+            return "low latency";
+        case VKPresentGoal::PowerSaving:
+            return "power saving";
+        case VKPresentGoal::MaxThroughput:
+            return "max throughput";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "utils.h"
+
+#include <chrono>
+
+/*
+ * What the swapchain should be tuned for.
+ *
+ * LowLatency:    the newest frame is shown at the next vblank without tearing
+ *                (MAILBOX), or as soon as possible (IMMEDIATE).
+ * PowerSaving:   vsync (FIFO) with the fewest images, the GPU idles between
+ *                vblanks.
+ * MaxThroughput: never block on present (IMMEDIATE / MAILBOX) and keep an
+ *                extra image queued.
+ */
+enum class VKPresentGoal {
+    LowLatency,
+    PowerSaving,
+    MaxThroughput
+};
+
+struct VKPresentConfig {
+    VkPresentModeKHR presentMode;
+    uint32_t imageCount;
+};
+
+/*
+ * VKPresentPolicy picks the present mode and the swapchain image count for a
+ * VKPresentGoal out of what the surface supports. FIFO is always supported,
+ * so every goal falls back to it.
+ *
+ * It also measures the CPU time from the start of vkAcquireNextImageKHR to
+ * the return of vkQueuePresentKHR, separately for every present mode used.
+ * That is the frame's whole CPU side (acquire, uniform update, recording,
+ * submit and present), so compare it between modes rather than read it as
+ * presentation engine wait. The numbers are logged every time the mode
+ * changes and on logStats().
+ */
+class VKPresentPolicy
+{
+    public:
+        VKPresentPolicy() {};
+        ~VKPresentPolicy() {};
+
+        // called by createSwapChain(), remembers the goal and the mode.
+        VKPresentConfig choose(VKPresentGoal goal, const SwapChainSupportDetails &support);
+        VKPresentGoal getGoal() const { return goal; }
+
+        // bracket the acquire ... present of one frame.
+        void beginFrame();
+        void endFrame();
+
+        void logStats();
+
+        static const char *getModeName(VkPresentModeKHR presentMode);
+        static const char *getGoalName(VKPresentGoal goal);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+        // FIFO_RELAXED is the last of the four core modes.
+        static const uint32_t MODE_COUNT = VK_PRESENT_MODE_FIFO_RELAXED_KHR + 1;
+
+        struct ModeStats {
+            uint32_t frames = 0;
+            double totalMs = 0.0;
+            double maxMs = 0.0;
+        };
+
+        VKPresentGoal goal = VKPresentGoal::PowerSaving;
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        bool chosen = false;
+
+        Clock::time_point acquireTime;
+        bool inFrame = false;
+        ModeStats stats[MODE_COUNT];
+};
@@ -0,0 +1,499 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vk_shader_cache.h"
+
+// "VKSI", bumped with the layout of the file.
+static const uint32_t SHADER_FILE_MAGIC = 0x49534b56;
+static const uint32_t SHADER_FILE_VERSION = 3;
+
+// bounds checked reads from the saved shader infos.
+struct Reader {
+    const std::vector<uint8_t> &data;
+    size_t offset;
+
+    bool read(void *value, size_t size) {
+        if (size > data.size() - offset) {
+            return false;
+        }
+        memcpy(value, data.data() + offset, size);
+        offset += size;
+
+        return true;
+    }
+
+    template <typename T>
+    bool readVector(std::vector<T> &values) {
+        uint32_t count = 0;
+        if (!read(&count, sizeof(count)) || count > (data.size() - offset) / sizeof(T)) {
+            return false;
+        }
+        values.resize(count);
+
+        return read(values.data(), count * sizeof(T));
+    }
+};
+
+static void write(std::vector<uint8_t> &data, const void *value, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    data.insert(data.end(), bytes, bytes + size);
+
+    return;
+}
+
+// the reflection structs are plain data, written as they are in memory.
+template <typename T>
+static void writeVector(std::vector<uint8_t> &data, const std::vector<T> &values)
+{
+    uint32_t count = static_cast<uint32_t>(values.size());
+    write(data, &count, sizeof(count));
+    write(data, values.data(), values.size() * sizeof(T));
+
+    return;
+}
+
+VKShaderIdentifierSupport VKShaderCache::query(VkInstance instance,
+                                               VkPhysicalDevice physicalDevice)
+{
+    VKShaderIdentifierSupport support;
+
+#ifdef VK_EXT_shader_module_identifier
+    auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+    if (getProperties2 == nullptr) {
+        return support;
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount,
+                                         extensions.data());
+
+    bool identifier = false;
+    bool cacheControl = false;
+    for (const auto &extension : extensions) {
+        if (strcmp(extension.extensionName,
+                   VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME) == 0) {
+            identifier = true;
+        } else if (strcmp(extension.extensionName,
+                          VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME) == 0) {
+            cacheControl = true;
+        }
+    }
+    if (!identifier || !cacheControl) {
+        return support;
+    }
+
+    VkPhysicalDeviceShaderModuleIdentifierPropertiesEXT identifierProperties{};
+    identifierProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &identifierProperties;
+    getProperties2(physicalDevice, &properties);
+
+    support.shaderModuleIdentifier = true;
+    memcpy(support.algorithmUUID, identifierProperties.shaderModuleIdentifierAlgorithmUUID,
+           VK_UUID_SIZE);
+#else
+    (void)instance;
+    (void)physicalDevice;
+#endif
+
+    LOGI("shader module identifier: %s", support.shaderModuleIdentifier ? "yes" : "no");
+
+    return support;
+}
+
+void VKShaderCache::enable(const VKShaderIdentifierSupport &support,
+                           std::vector<const char *> &extensions,
+                           DeviceFeatures &features, const void **pNext)
+{
+    features = DeviceFeatures{};
+#ifdef VK_EXT_shader_module_identifier
+    if (support.shaderModuleIdentifier) {
+        extensions.push_back(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME);
+        // needed for VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT.
+        features.cacheControl.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES_EXT;
+        features.cacheControl.pipelineCreationCacheControl = VK_TRUE;
+        features.cacheControl.pNext = const_cast<void *>(*pNext);
+        features.shaderModuleIdentifier.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+        features.shaderModuleIdentifier.shaderModuleIdentifier = VK_TRUE;
+        features.shaderModuleIdentifier.pNext = &features.cacheControl;
+        *pNext = &features.shaderModuleIdentifier;
+    }
+#else
+    (void)support;
+    (void)extensions;
+    (void)pNext;
+#endif
+
+    return;
+}
+
+void VKShaderCache::init(AAssetManager *assetManager, const std::string &path)
+{
+    this->assetManager = assetManager;
+    this->path = path;
+    unsaved = false;
+    moduleCount = 0;
+    sharedCount = 0;
+    bytesRead = 0;
+    skippedReads = 0;
+
+    std::vector<uint8_t> data;
+    if (!path.empty() && ReadFileToVector(path, data)) {
+        loadShaderInfos(data);
+    }
+
+    return;
+}
+
+void VKShaderCache::loadShaderInfos(const std::vector<uint8_t> &data)
+{
+    Reader reader{data, 0};
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+    if (!reader.read(&magic, sizeof(magic)) || magic != SHADER_FILE_MAGIC ||
+        !reader.read(&version, sizeof(version)) || version != SHADER_FILE_VERSION ||
+        !reader.read(savedAlgorithmUUID, VK_UUID_SIZE) ||
+        !reader.read(&count, sizeof(count))) {
+        LOGI("shader cache: %s is invalid, ignored", path.c_str());
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pathLength = 0;
+        std::string shaderPath;
+        ShaderInfo info;
+        uint32_t reflected = 0;
+        uint32_t stage = 0;
+        bool ok = reader.read(&pathLength, sizeof(pathLength)) &&
+                  pathLength <= data.size() - reader.offset;
+        if (ok) {
+            shaderPath.assign(reinterpret_cast<const char *>(data.data() + reader.offset),
+                              pathLength);
+            reader.offset += pathLength;
+        }
+        ok = ok && reader.read(&info.codeHash, sizeof(info.codeHash)) &&
+             reader.read(&info.identifier.size, sizeof(info.identifier.size)) &&
+             info.identifier.size <= MAX_SHADER_IDENTIFIER_SIZE &&
+             reader.read(info.identifier.data, info.identifier.size) &&
+             reader.read(&reflected, sizeof(reflected)) &&
+             reader.read(&stage, sizeof(stage)) &&
+             reader.read(&info.reflection.pushConstantSize,
+                         sizeof(info.reflection.pushConstantSize)) &&
+             reader.readVector(info.reflection.bindings) &&
+             reader.readVector(info.reflection.vertexInputs);
+        if (!ok) {
+            LOGI("shader cache: %s is truncated, ignored", path.c_str());
+            shaders.clear();
+            return;
+        }
+        info.reflected = reflected != 0;
+        info.reflection.stage = static_cast<VkShaderStageFlagBits>(stage);
+
+        // the saved data is of the code, which changes with the app: an edit
+        // that keeps the size would otherwise run a stale pipeline from the
+        // identifier. Hashing is far cheaper than creating the module.
+        AAsset *asset = AAssetManager_open(assetManager, shaderPath.c_str(),
+                                           AASSET_MODE_BUFFER);
+        if (asset == nullptr) {
+            continue;
+        }
+        const void *code = AAsset_getBuffer(asset);
+        size_t codeSize = static_cast<size_t>(AAsset_getLength(asset));
+        bool sameCode = code != nullptr && HashFNV1a(code, codeSize) == info.codeHash;
+        AAsset_close(asset);
+        bytesRead += codeSize;
+        if (sameCode) {
+            shaders[shaderPath] = info;
+        }
+    }
+
+    return;
+}
+
+void VKShaderCache::setDevice(VkDevice device, const VKShaderIdentifierSupport &support)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->device = device;
+    this->support = support;
+
+#ifdef VK_EXT_shader_module_identifier
+    getShaderModuleIdentifier = nullptr;
+    if (support.shaderModuleIdentifier) {
+        getShaderModuleIdentifier = reinterpret_cast<PFN_vkGetShaderModuleIdentifierEXT>(
+            vkGetDeviceProcAddr(device, "vkGetShaderModuleIdentifierEXT"));
+    }
+    if (getShaderModuleIdentifier == nullptr) {
+        this->support.shaderModuleIdentifier = false;
+    }
+#endif
+
+    // the reflection doesn't depend on the driver, only the identifiers do.
+    if (!this->support.shaderModuleIdentifier ||
+        memcmp(savedAlgorithmUUID, support.algorithmUUID, VK_UUID_SIZE) != 0) {
+        for (auto &shader : shaders) {
+            shader.second.identifier.size = 0;
+        }
+    }
+    LOGI("shader cache: %zu shaders loaded", shaders.size());
+
+    return;
+}
+
+void VKShaderCache::destroy()
+{
+    save();
+    logStats();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &module : modules) {
+        vkDestroyShaderModule(device, module.second.module, VULKAN_CPU_ALLOCATOR);
+    }
+    modules.clear();
+    pathHashes.clear();
+    code.clear();
+    shaders.clear();
+    device = VK_NULL_HANDLE;
+
+    return;
+}
+
+std::vector<uint8_t> VKShaderCache::readCode(const std::string &path)
+{
+    std::vector<uint8_t> data = LoadBinaryFileToVector(path.c_str(), assetManager);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bytesRead += data.size();
+
+    return data;
+}
+
+void VKShaderCache::prefetch(const std::vector<const char *> &paths, VKJobSystem &jobSystem)
+{
+    std::vector<std::string> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const char *path : paths) {
+            auto it = shaders.find(path);
+            bool withoutCode = it != shaders.end() && it->second.reflected &&
+                               it->second.identifier.size > 0;
+            if (withoutCode) {
+                skippedReads++;
+            } else if (code.count(path) == 0 && pathHashes.count(path) == 0) {
+                pending.push_back(path);
+            }
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> data(pending.size());
+    jobSystem.parallelFor(static_cast<uint32_t>(pending.size()), 1,
+                          [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            data[i] = readCode(pending[i]);
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < pending.size(); i++) {
+        code[pending[i]] = std::move(data[i]);
+    }
+
+    return;
+}
+
+VkShaderModule VKShaderCache::getModule(const char *path)
+{
+    std::vector<uint8_t> spirv;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pathHashes.find(path);
+        if (it != pathHashes.end()) {
+            return modules[it->second].module;
+        }
+        auto codeIt = code.find(path);
+        if (codeIt != code.end()) {
+            spirv = std::move(codeIt->second);
+            code.erase(codeIt);
+        }
+    }
+    // read outside the lock, two compiles racing for it read it twice.
+    if (spirv.empty()) {
+        spirv = readCode(path);
+    }
+    uint64_t hash = HashFNV1a(spirv.data(), spirv.size());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pathHashes.find(path);
+    if (it != pathHashes.end()) {
+        return modules[it->second].module;
+    }
+
+    Module &module = modules[hash];
+    if (module.module != VK_NULL_HANDLE) {
+        assert(module.codeSize == spirv.size());  // shader hash collision!
+        sharedCount++;
+    } else {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = spirv.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(spirv.data());
+        VK_CHECK(vkCreateShaderModule(device, &createInfo, VULKAN_CPU_ALLOCATOR,
+                                      &module.module));
+        module.codeSize = spirv.size();
+        moduleCount++;
+    }
+    pathHashes[path] = hash;
+
+    ShaderInfo &info = shaders[path];
+    reflect(info, spirv, hash);
+#ifdef VK_EXT_shader_module_identifier
+    if (support.shaderModuleIdentifier) {
+        VkShaderModuleIdentifierEXT moduleIdentifier{};
+        moduleIdentifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+        getShaderModuleIdentifier(device, module.module, &moduleIdentifier);
+
+        VKShaderIdentifier identifier;
+        identifier.size = std::min(moduleIdentifier.identifierSize, MAX_SHADER_IDENTIFIER_SIZE);
+        memcpy(identifier.data, moduleIdentifier.identifier, identifier.size);
+        if (info.identifier.size != identifier.size ||
+            memcmp(info.identifier.data, identifier.data, identifier.size) != 0) {
+            info.identifier = identifier;
+            unsaved = true;
+        }
+    }
+#endif
+
+    return module.module;
+}
+
+bool VKShaderCache::getIdentifier(const char *path, VKShaderIdentifier &identifier)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = shaders.find(path);
+    if (it == shaders.end() || it->second.identifier.size == 0) {
+        return false;
+    }
+    identifier = it->second.identifier;
+
+    return true;
+}
+
+void VKShaderCache::reflect(ShaderInfo &info, const std::vector<uint8_t> &code,
+                            uint64_t codeHash)
+{
+    if (info.reflected && info.codeHash == codeHash) {
+        return;
+    }
+
+    bool ok = info.reflection.parse(code);
+    assert(ok);  // the shader can't be reflected!
+    (void)ok;
+    info.reflected = true;
+    info.codeHash = codeHash;
+    unsaved = true;
+
+    return;
+}
+
+VKShaderReflection VKShaderCache::getReflection(const char *path)
+{
+    std::vector<uint8_t> spirv;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = shaders.find(path);
+        if (it != shaders.end() && it->second.reflected) {
+            return it->second.reflection;
+        }
+        auto codeIt = code.find(path);
+        if (codeIt != code.end()) {
+            spirv = codeIt->second;
+        }
+    }
+    if (spirv.empty()) {
+        spirv = readCode(path);
+    }
+    uint64_t hash = HashFNV1a(spirv.data(), spirv.size());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ShaderInfo &info = shaders[path];
+    reflect(info, spirv, hash);
+    // getModule() needs it next.
+    if (pathHashes.count(path) == 0 && code.count(path) == 0) {
+        code[path] = std::move(spirv);
+    }
+
+    return info.reflection;
+}
+
+void VKShaderCache::save()
+{
+    std::vector<uint8_t> data;
+    uint32_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (path.empty() || !unsaved) {
+            return;
+        }
+        unsaved = false;
+
+        count = static_cast<uint32_t>(shaders.size());
+        write(data, &SHADER_FILE_MAGIC, sizeof(SHADER_FILE_MAGIC));
+        write(data, &SHADER_FILE_VERSION, sizeof(SHADER_FILE_VERSION));
+        write(data, support.algorithmUUID, VK_UUID_SIZE);
+        write(data, &count, sizeof(count));
+        for (const auto &shader : shaders) {
+            uint32_t pathLength = static_cast<uint32_t>(shader.first.size());
+            const ShaderInfo &info = shader.second;
+            uint32_t reflected = info.reflected ? 1 : 0;
+            uint32_t stage = static_cast<uint32_t>(info.reflection.stage);
+            write(data, &pathLength, sizeof(pathLength));
+            write(data, shader.first.data(), pathLength);
+            write(data, &info.codeHash, sizeof(info.codeHash));
+            write(data, &info.identifier.size, sizeof(info.identifier.size));
+            write(data, info.identifier.data, info.identifier.size);
+            write(data, &reflected, sizeof(reflected));
+            write(data, &stage, sizeof(stage));
+            write(data, &info.reflection.pushConstantSize,
+                  sizeof(info.reflection.pushConstantSize));
+            writeVector(data, info.reflection.bindings);
+            writeVector(data, info.reflection.vertexInputs);
+        }
+    }
+
+    if (!WriteFileAtomic(path, data)) {
+        LOGE("shader cache: failed to save %s", path.c_str());
+        return;
+    }
+
+    LOGI("shader cache: saved %zu bytes for %u shaders", data.size(), count);
+
+    return;
+}
+
+void VKShaderCache::logStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t identifierOnly = 0;
+    for (const auto &shader : shaders) {
+        if (shader.second.identifier.size > 0 && pathHashes.count(shader.first) == 0) {
+            identifierOnly++;
+        }
+    }
+
+    LOGI("shader cache: %u modules for %zu shaders (%u shared), %zu bytes of SPIR-V "
+         "read, %u prefetches skipped, %zu shaders without a module (identifier only)",
+         moduleCount, pathHashes.size(), sharedCount, bytesRead, skippedReads,
+         identifierOnly);
+
+    return;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "utils.h"
+#include "vk_job_system.h"
+#include "vk_shader_reflection.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT, usable without the extension headers.
+const uint32_t MAX_SHADER_IDENTIFIER_SIZE = 32;
+
+// the driver's name for a shader module, see VK_EXT_shader_module_identifier.
+struct VKShaderIdentifier {
+    uint32_t size = 0;
+    uint8_t data[MAX_SHADER_IDENTIFIER_SIZE] = {};
+};
+
+struct VKShaderIdentifierSupport {
+    // VK_EXT_shader_module_identifier with VK_EXT_pipeline_creation_cache_control.
+    bool shaderModuleIdentifier = false;
+    // identifiers are only valid for drivers with the same algorithm.
+    uint8_t algorithmUUID[VK_UUID_SIZE] = {};
+};
+
+/*
+ * VKShaderCache owns the shader modules of the app. Each SPIR-V asset is
+ * read once, modules are deduplicated by the FNV-1a hash of their code (two
+ * paths with the same code share one module) and kept until destroy(), so
+ * pipelines can be created from them at any time.
+ *
+ * getReflection() returns the VKShaderReflection of a shader, parsed from
+ * its SPIR-V the first time and saved with the identifiers below, so the
+ * layouts and vertex input of a pipeline are known without the code.
+ *
+ * With VK_EXT_shader_module_identifier the identifier of every module is
+ * saved next to the pipeline cache as well. On the next launch the pipeline
+ * registry first tries to create pipelines from the identifiers alone,
+ * which only succeeds when the pipeline cache has them, and the SPIR-V of
+ * those shaders is only hashed, never turned into a module. prefetch() skips
+ * them. Saved data is dropped when the FNV-1a hash of the asset changed,
+ * identifiers also when the driver uses another identifier algorithm.
+ *
+ * Thread safe, pipelines compile on the job system.
+ */
+class VKShaderCache
+{
+    public:
+        static VKShaderIdentifierSupport query(VkInstance instance,
+                                               VkPhysicalDevice physicalDevice);
+
+        // the extension names and feature structs vkCreateDevice needs for
+        // support, chained in front of *pNext. features must outlive the call.
+        struct DeviceFeatures {
+#ifdef VK_EXT_shader_module_identifier
+            VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT shaderModuleIdentifier;
+            VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT cacheControl;
+#endif
+        };
+        static void enable(const VKShaderIdentifierSupport &support,
+                           std::vector<const char *> &extensions,
+                           DeviceFeatures &features, const void **pNext);
+
+        VKShaderCache() {};
+        ~VKShaderCache() {};
+
+        // loads the shaders saved at path, no device needed yet. path
+        // empty: nothing is kept across launches.
+        void init(AAssetManager *assetManager, const std::string &path);
+        // support as passed to enable(), right after the device is created.
+        void setDevice(VkDevice device, const VKShaderIdentifierSupport &support);
+        // saves, then destroys every module. No pipeline may be created anymore.
+        void destroy();
+
+        // reads the code of paths without an identifier or reflection, one
+        // job per file.
+        void prefetch(const std::vector<const char *> &paths, VKJobSystem &jobSystem);
+
+        VkShaderModule getModule(const char *path);
+        // false if path has no identifier (yet).
+        bool getIdentifier(const char *path, VKShaderIdentifier &identifier);
+        VKShaderReflection getReflection(const char *path);
+
+        // writes identifiers and reflections if new ones were added since
+        // the last save.
+        void save();
+        void logStats();
+
+    private:
+        struct Module {
+            VkShaderModule module = VK_NULL_HANDLE;
+            size_t codeSize = 0;
+        };
+        // what is saved of a shader.
+        struct ShaderInfo {
+            // HashFNV1a() of the asset the rest was created for.
+            uint64_t codeHash = 0;
+            // size 0 without one.
+            VKShaderIdentifier identifier;
+            bool reflected = false;
+            VKShaderReflection reflection;
+        };
+
+        std::vector<uint8_t> readCode(const std::string &path);
+        void loadShaderInfos(const std::vector<uint8_t> &data);
+        // parses code if info is not reflected yet, with the lock held.
+        void reflect(ShaderInfo &info, const std::vector<uint8_t> &code, uint64_t codeHash);
+
+        AAssetManager *assetManager = nullptr;
+        VkDevice device = VK_NULL_HANDLE;
+        std::string path;
+        VKShaderIdentifierSupport support;
+#ifdef VK_EXT_shader_module_identifier
+        PFN_vkGetShaderModuleIdentifierEXT getShaderModuleIdentifier = nullptr;
+#endif
+
+        std::mutex mutex;
+        // code read by prefetch(), released once its module is created.
+        std::unordered_map<std::string, std::vector<uint8_t>> code;
+        std::unordered_map<uint64_t, Module> modules;
+        std::unordered_map<std::string, uint64_t> pathHashes;
+        std::unordered_map<std::string, ShaderInfo> shaders;
+        // identifiers in the file before the device algorithm is known.
+        uint8_t savedAlgorithmUUID[VK_UUID_SIZE] = {};
+        bool unsaved = false;
+
+        uint32_t moduleCount = 0;
+        uint32_t sharedCount = 0;
+        // prefetch() paths not read, their identifier and reflection are known.
+        uint32_t skippedReads = 0;
+        size_t bytesRead = 0;
+};
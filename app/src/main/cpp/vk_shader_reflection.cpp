@@ -0,0 +1,445 @@
+#include <string.h>
+#include <algorithm>
+
+#include "vk_shader_reflection.h"
+
+// the parts of spirv.h the reflection needs.
+static const uint32_t SPIRV_MAGIC = 0x07230203;
+static const uint32_t SPIRV_HEADER_WORDS = 5;
+
+enum SpvOp : uint32_t {
+    OP_ENTRY_POINT = 15,
+    OP_TYPE_BOOL = 20,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_MATRIX = 24,
+    OP_TYPE_IMAGE = 25,
+    OP_TYPE_SAMPLER = 26,
+    OP_TYPE_SAMPLED_IMAGE = 27,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_CONSTANT = 43,
+    OP_VARIABLE = 59,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72
+};
+
+enum SpvDecoration : uint32_t {
+    DECORATION_BLOCK = 2,
+    DECORATION_BUFFER_BLOCK = 3,
+    DECORATION_ARRAY_STRIDE = 6,
+    DECORATION_MATRIX_STRIDE = 7,
+    DECORATION_BUILT_IN = 11,
+    DECORATION_LOCATION = 30,
+    DECORATION_BINDING = 33,
+    DECORATION_DESCRIPTOR_SET = 34,
+    DECORATION_OFFSET = 35
+};
+
+enum SpvStorageClass : uint32_t {
+    STORAGE_CLASS_UNIFORM_CONSTANT = 0,
+    STORAGE_CLASS_INPUT = 1,
+    STORAGE_CLASS_UNIFORM = 2,
+    STORAGE_CLASS_PUSH_CONSTANT = 9,
+    STORAGE_CLASS_STORAGE_BUFFER = 12
+};
+
+static const uint32_t DIM_BUFFER = 5;
+static const uint32_t DIM_SUBPASS_DATA = 6;
+
+// a result id: the instruction that defines it and its decorations.
+struct SpvId {
+    const uint32_t *instruction = nullptr;
+    uint32_t wordCount = 0;
+
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    uint32_t location = 0;
+    uint32_t arrayStride = 0;
+    bool hasBinding = false;
+    bool hasLocation = false;
+    bool builtIn = false;
+    bool bufferBlock = false;
+    // OpMemberDecorate Offset and MatrixStride of struct types.
+    std::vector<uint32_t> memberOffsets;
+    std::vector<uint32_t> memberMatrixStrides;
+
+    uint32_t getOpcode() const { return instruction != nullptr ? instruction[0] & 0xffff : 0; }
+};
+
+// fewest words of the instructions a result id is kept for.
+static uint32_t getMinWordCount(uint32_t opcode)
+{
+    switch (opcode) {
+        case OP_TYPE_BOOL:
+        case OP_TYPE_SAMPLER:
+        case OP_TYPE_STRUCT:
+            return 2;
+        case OP_TYPE_FLOAT:
+        case OP_TYPE_SAMPLED_IMAGE:
+        case OP_TYPE_RUNTIME_ARRAY:
+            return 3;
+        case OP_TYPE_INT:
+        case OP_TYPE_VECTOR:
+        case OP_TYPE_MATRIX:
+        case OP_TYPE_ARRAY:
+        case OP_TYPE_POINTER:
+        case OP_CONSTANT:
+        case OP_VARIABLE:
+            return 4;
+        case OP_TYPE_IMAGE:
+            return 9;
+        default:
+            return 0;
+    }
+}
+
+static const SpvId *getId(const std::vector<SpvId> &ids, uint32_t id)
+{
+    return id < ids.size() && ids[id].instruction != nullptr ? &ids[id] : nullptr;
+}
+
+static uint32_t getConstant(const std::vector<SpvId> &ids, uint32_t id)
+{
+    const SpvId *constant = getId(ids, id);
+
+    return constant != nullptr && constant->getOpcode() == OP_CONSTANT ?
+           constant->instruction[3] : 1;
+}
+
+// bytes of a push constant type, with the explicit layout of the block.
+static uint32_t getTypeSize(const std::vector<SpvId> &ids, uint32_t typeId)
+{
+    const SpvId *type = getId(ids, typeId);
+    if (type == nullptr) {
+        return 0;
+    }
+
+    const uint32_t *instruction = type->instruction;
+    switch (type->getOpcode()) {
+        case OP_TYPE_BOOL:
+            return 4;
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+            return instruction[2] / 8;
+        case OP_TYPE_VECTOR:
+        case OP_TYPE_MATRIX:
+            return getTypeSize(ids, instruction[2]) * instruction[3];
+        case OP_TYPE_ARRAY: {
+            uint32_t stride = type->arrayStride != 0 ?
+                              type->arrayStride : getTypeSize(ids, instruction[2]);
+            return stride * getConstant(ids, instruction[3]);
+        }
+        case OP_TYPE_STRUCT: {
+            uint32_t size = 0;
+            for (uint32_t member = 0; member + 2 < type->wordCount; member++) {
+                uint32_t memberType = instruction[member + 2];
+                uint32_t memberSize = getTypeSize(ids, memberType);
+                const SpvId *matrix = getId(ids, memberType);
+                if (matrix != nullptr && matrix->getOpcode() == OP_TYPE_MATRIX &&
+                    member < type->memberMatrixStrides.size() &&
+                    type->memberMatrixStrides[member] != 0) {
+                    memberSize = type->memberMatrixStrides[member] * matrix->instruction[3];
+                }
+                uint32_t offset = member < type->memberOffsets.size() ?
+                                  type->memberOffsets[member] : size;
+                size = std::max(size, offset + memberSize);
+            }
+            return size;
+        }
+        default:
+            return 0;
+    }
+}
+
+static bool getDescriptorType(const std::vector<SpvId> &ids, uint32_t typeId,
+                              uint32_t storageClass, VkDescriptorType &descriptorType)
+{
+    const SpvId *type = getId(ids, typeId);
+    if (type == nullptr) {
+        return false;
+    }
+
+    switch (type->getOpcode()) {
+        case OP_TYPE_STRUCT:
+            if (storageClass == STORAGE_CLASS_STORAGE_BUFFER ||
+                (storageClass == STORAGE_CLASS_UNIFORM && type->bufferBlock)) {
+                descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            } else {
+                descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            }
+            return true;
+        case OP_TYPE_SAMPLED_IMAGE:
+            descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case OP_TYPE_SAMPLER:
+            descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case OP_TYPE_IMAGE: {
+            uint32_t dim = type->instruction[3];
+            // 1: used with a sampler, 2: read/write.
+            bool storage = type->instruction[7] == 2;
+            if (dim == DIM_SUBPASS_DATA) {
+                descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            } else if (dim == DIM_BUFFER) {
+                descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER :
+                                           VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else {
+                descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE :
+                                           VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static VkFormat getVertexFormat(const std::vector<SpvId> &ids, uint32_t typeId,
+                                uint32_t &size)
+{
+    static const VkFormat floatFormats[4] = {
+        VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+        VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat intFormats[4] = {
+        VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT,
+        VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uintFormats[4] = {
+        VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT,
+        VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    const SpvId *type = getId(ids, typeId);
+    uint32_t components = 1;
+    if (type != nullptr && type->getOpcode() == OP_TYPE_VECTOR) {
+        components = type->instruction[3];
+        type = getId(ids, type->instruction[2]);
+    }
+    // 32 bit float and int scalars and vectors only.
+    if (type == nullptr || components < 1 || components > 4 ||
+        (type->getOpcode() != OP_TYPE_FLOAT && type->getOpcode() != OP_TYPE_INT) ||
+        type->instruction[2] != 32) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    size = components * 4;
+    if (type->getOpcode() == OP_TYPE_FLOAT) {
+        return floatFormats[components - 1];
+    }
+
+    return type->instruction[3] != 0 ? intFormats[components - 1] : uintFormats[components - 1];
+}
+
+static VkShaderStageFlagBits getStage(uint32_t executionModel)
+{
+    switch (executionModel) {
+        case 1:
+            return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2:
+            return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3:
+            return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4:
+            return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5:
+            return VK_SHADER_STAGE_COMPUTE_BIT;
+        default:
+            return VK_SHADER_STAGE_VERTEX_BIT;
+    }
+}
+
+static void decorate(SpvId &id, uint32_t decoration, const uint32_t *value)
+{
+    switch (decoration) {
+        case DECORATION_BUFFER_BLOCK:
+            id.bufferBlock = true;
+            break;
+        case DECORATION_BUILT_IN:
+            id.builtIn = true;
+            break;
+        case DECORATION_ARRAY_STRIDE:
+            id.arrayStride = value != nullptr ? *value : 0;
+            break;
+        case DECORATION_LOCATION:
+            id.location = value != nullptr ? *value : 0;
+            id.hasLocation = value != nullptr;
+            break;
+        case DECORATION_BINDING:
+            id.binding = value != nullptr ? *value : 0;
+            id.hasBinding = value != nullptr;
+            break;
+        case DECORATION_DESCRIPTOR_SET:
+            id.set = value != nullptr ? *value : 0;
+            break;
+        default:
+            break;
+    }
+
+    return;
+}
+
+static void decorateMember(SpvId &id, uint32_t member, uint32_t decoration,
+                           const uint32_t *value)
+{
+    if (value == nullptr || member > 1024) {
+        return;
+    }
+
+    if (decoration == DECORATION_OFFSET) {
+        id.memberOffsets.resize(std::max<size_t>(id.memberOffsets.size(), member + 1));
+        id.memberOffsets[member] = *value;
+    } else if (decoration == DECORATION_MATRIX_STRIDE) {
+        id.memberMatrixStrides.resize(
+            std::max<size_t>(id.memberMatrixStrides.size(), member + 1));
+        id.memberMatrixStrides[member] = *value;
+    }
+
+    return;
+}
+
+bool VKShaderReflection::parse(const std::vector<uint8_t> &code)
+{
+    stage = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings.clear();
+    vertexInputs.clear();
+    pushConstantSize = 0;
+
+    if (code.size() < SPIRV_HEADER_WORDS * 4 || code.size() % 4 != 0) {
+        return false;
+    }
+    // the asset data has no alignment guarantee.
+    std::vector<uint32_t> words(code.size() / 4);
+    memcpy(words.data(), code.data(), code.size());
+    if (words[0] != SPIRV_MAGIC) {
+        return false;
+    }
+
+    uint32_t bound = words[3];
+    if (bound > words.size()) {
+        return false;
+    }
+    std::vector<SpvId> ids(bound);
+    std::vector<uint32_t> variables;
+    bool hasEntryPoint = false;
+
+    for (size_t offset = SPIRV_HEADER_WORDS; offset < words.size();) {
+        const uint32_t *instruction = &words[offset];
+        uint32_t opcode = instruction[0] & 0xffff;
+        uint32_t wordCount = instruction[0] >> 16;
+        if (wordCount == 0 || wordCount > words.size() - offset) {
+            return false;
+        }
+        offset += wordCount;
+
+        if (opcode == OP_ENTRY_POINT && wordCount >= 2) {
+            // the first one, the samples' shaders have a single main.
+            if (!hasEntryPoint) {
+                stage = getStage(instruction[1]);
+                hasEntryPoint = true;
+            }
+        } else if (opcode == OP_DECORATE && wordCount >= 3 && instruction[1] < bound) {
+            decorate(ids[instruction[1]], instruction[2],
+                     wordCount >= 4 ? &instruction[3] : nullptr);
+        } else if (opcode == OP_MEMBER_DECORATE && wordCount >= 4 && instruction[1] < bound) {
+            decorateMember(ids[instruction[1]], instruction[2], instruction[3],
+                           wordCount >= 5 ? &instruction[4] : nullptr);
+        } else if (getMinWordCount(opcode) != 0) {
+            if (wordCount < getMinWordCount(opcode)) {
+                return false;
+            }
+            // constants and variables have their result type first.
+            uint32_t result = (opcode == OP_CONSTANT || opcode == OP_VARIABLE) ?
+                              instruction[2] : instruction[1];
+            if (result >= bound) {
+                return false;
+            }
+            ids[result].instruction = instruction;
+            ids[result].wordCount = wordCount;
+            if (opcode == OP_VARIABLE) {
+                variables.push_back(result);
+            }
+        }
+    }
+    if (!hasEntryPoint) {
+        return false;
+    }
+
+    for (uint32_t variableId : variables) {
+        const SpvId &variable = ids[variableId];
+        uint32_t storageClass = variable.instruction[3];
+        const SpvId *pointer = getId(ids, variable.instruction[1]);
+        if (pointer == nullptr || pointer->getOpcode() != OP_TYPE_POINTER) {
+            return false;
+        }
+        uint32_t typeId = pointer->instruction[3];
+
+        if (storageClass == STORAGE_CLASS_UNIFORM ||
+            storageClass == STORAGE_CLASS_UNIFORM_CONSTANT ||
+            storageClass == STORAGE_CLASS_STORAGE_BUFFER) {
+            if (!variable.hasBinding) {
+                continue;
+            }
+            VKDescriptorBinding binding;
+            binding.set = variable.set;
+            binding.binding = variable.binding;
+            binding.stages = stage;
+            // arrays of resources, runtime sized ones count as one.
+            const SpvId *type = getId(ids, typeId);
+            while (type != nullptr && (type->getOpcode() == OP_TYPE_ARRAY ||
+                                       type->getOpcode() == OP_TYPE_RUNTIME_ARRAY)) {
+                if (type->getOpcode() == OP_TYPE_ARRAY) {
+                    binding.count *= getConstant(ids, type->instruction[3]);
+                }
+                typeId = type->instruction[2];
+                type = getId(ids, typeId);
+            }
+            if (!getDescriptorType(ids, typeId, storageClass, binding.type)) {
+                LOGE("shader reflection: unsupported resource at set %u binding %u",
+                     binding.set, binding.binding);
+                return false;
+            }
+            bindings.push_back(binding);
+        } else if (storageClass == STORAGE_CLASS_PUSH_CONSTANT) {
+            pushConstantSize = std::max(pushConstantSize, getTypeSize(ids, typeId));
+        } else if (storageClass == STORAGE_CLASS_INPUT && stage == VK_SHADER_STAGE_VERTEX_BIT &&
+                   !variable.builtIn && variable.hasLocation) {
+            VKVertexInput input;
+            input.location = variable.location;
+            input.format = getVertexFormat(ids, typeId, input.size);
+            if (input.format == VK_FORMAT_UNDEFINED) {
+                LOGE("shader reflection: unsupported vertex input at location %u",
+                     input.location);
+                return false;
+            }
+            vertexInputs.push_back(input);
+        }
+    }
+
+    std::sort(bindings.begin(), bindings.end(),
+              [](const VKDescriptorBinding &a, const VKDescriptorBinding &b) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+    std::sort(vertexInputs.begin(), vertexInputs.end(),
+              [](const VKVertexInput &a, const VKVertexInput &b) {
+        return a.location < b.location;
+    });
+
+    return true;
+}
+
+uint32_t VKShaderReflection::getVertexInput(
+    VkVertexInputAttributeDescription *attributes) const
+{
+    uint32_t stride = 0;
+    for (size_t i = 0; i < vertexInputs.size(); i++) {
+        attributes[i].binding = 0;
+        attributes[i].location = vertexInputs[i].location;
+        attributes[i].format = vertexInputs[i].format;
+        attributes[i].offset = stride;
+        stride += vertexInputs[i].size;
+    }
+
+    return stride;
+}
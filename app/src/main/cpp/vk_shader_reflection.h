@@ -0,0 +1,51 @@
+#pragma once
+
+#include "utils.h"
+
+#include <vector>
+
+// a resource the shader declares with layout(set = ..., binding = ...).
+struct VKDescriptorBinding {
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uint32_t count = 1;
+    VkShaderStageFlags stages = 0;
+};
+
+// a vertex shader input, layout(location = ...) in.
+struct VKVertexInput {
+    uint32_t location = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t size = 0;
+};
+
+/*
+ * VKShaderReflection is the interface of one SPIR-V binary: the descriptor
+ * bindings, the push constant block and, for vertex shaders, the vertex
+ * inputs. parse() walks the instructions once, only the decorations, types
+ * and variables are looked at.
+ *
+ * Uniform blocks are reported as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, whether
+ * they are bound with a dynamic offset is up to the layout, see
+ * VKPipelineInterface.
+ *
+ * getVertexInput() packs the inputs in location order into binding 0, which
+ * is how the samples' Vertex is laid out, so the offsets no longer have to
+ * be written by hand.
+ */
+struct VKShaderReflection {
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+    // sorted by set and binding.
+    std::vector<VKDescriptorBinding> bindings;
+    // sorted by location, vertex shaders only.
+    std::vector<VKVertexInput> vertexInputs;
+    // the push constant block covers [0, pushConstantSize).
+    uint32_t pushConstantSize = 0;
+
+    // false if code is not valid SPIR-V or uses something not handled here.
+    bool parse(const std::vector<uint8_t> &code);
+
+    // attributes needs vertexInputs.size() elements, returns the stride.
+    uint32_t getVertexInput(VkVertexInputAttributeDescription *attributes) const;
+};
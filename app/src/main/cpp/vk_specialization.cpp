@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <string.h>
+
+#include "vk_specialization.h"
+
+void VKSpecialization::set(uint32_t constantID, uint32_t bits)
+{
+    uint32_t i = 0;
+    while (i < count && constantIDs[i] < constantID) {
+        i++;
+    }
+    if (i < count && constantIDs[i] == constantID) {
+        values[i] = bits;
+        return;
+    }
+
+    assert(count < MAX_CONSTANTS);  // too many specialization constants!
+    for (uint32_t j = count; j > i; j--) {
+        constantIDs[j] = constantIDs[j - 1];
+        values[j] = values[j - 1];
+    }
+    constantIDs[i] = constantID;
+    values[i] = bits;
+    count++;
+
+    return;
+}
+
+void VKSpecialization::setFloat(uint32_t constantID, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    set(constantID, bits);
+
+    return;
+}
+
+void VKSpecialization::setInt(uint32_t constantID, int32_t value)
+{
+    set(constantID, static_cast<uint32_t>(value));
+
+    return;
+}
+
+void VKSpecialization::setBool(uint32_t constantID, bool value)
+{
+    set(constantID, value ? VK_TRUE : VK_FALSE);
+
+    return;
+}
+
+void VKSpecialization::getInfo(VkSpecializationInfo &info,
+                               VkSpecializationMapEntry *entries) const
+{
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].constantID = constantIDs[i];
+        entries[i].offset = i * sizeof(uint32_t);
+        entries[i].size = sizeof(uint32_t);
+    }
+    info.mapEntryCount = count;
+    info.pMapEntries = entries;
+    info.dataSize = count * sizeof(uint32_t);
+    info.pData = values;
+
+    return;
+}
+
+bool VKSpecialization::operator==(const VKSpecialization &other) const
+{
+    return count == other.count &&
+           memcmp(constantIDs, other.constantIDs, count * sizeof(uint32_t)) == 0 &&
+           memcmp(values, other.values, count * sizeof(uint32_t)) == 0;
+}
+
+uint64_t VKSpecialization::hash(uint64_t hash) const
+{
+    hash = HashFNV1a(&count, sizeof(count), hash);
+    hash = HashFNV1a(constantIDs, count * sizeof(uint32_t), hash);
+
+    return HashFNV1a(values, count * sizeof(uint32_t), hash);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "utils.h"
+
+// constant_id of the samples' shaders, see shaders/*.vert.
+enum VKSpecConstant : uint32_t {
+    // float, gl_PointSize (002).
+    SPEC_CONSTANT_POINT_SIZE = 0,
+    // int, a VKColorMode (001, 002).
+    SPEC_CONSTANT_COLOR_MODE = 1,
+    // float, the color of VKColorMode::Constant and of the 000 triangle.
+    SPEC_CONSTANT_COLOR_R = 2,
+    SPEC_CONSTANT_COLOR_G = 3,
+    SPEC_CONSTANT_COLOR_B = 4
+};
+
+// where the vertex shaders take the color from.
+enum class VKColorMode : int32_t {
+    // the color vertex attribute.
+    Vertex = 0,
+    // SPEC_CONSTANT_COLOR_R/G/B, the attribute is not read.
+    Constant = 1
+};
+
+/*
+ * VKSpecialization is the values of the specialization constants of a
+ * pipeline, shared by all its stages (constants a stage doesn't declare are
+ * ignored by it). Every set of values is a variant of the shaders the driver
+ * compiles with the constants folded in, so branches on them cost nothing.
+ *
+ * Part of VKPipelineState: the pipeline registry caches each variant like
+ * any other pipeline. Values are stored as 32 bits, bools as VkBool32, and
+ * kept sorted by constant id so the order of the set*() calls doesn't make
+ * a different variant.
+ */
+class VKSpecialization
+{
+    public:
+        static const uint32_t MAX_CONSTANTS = 8;
+
+        void setFloat(uint32_t constantID, float value);
+        void setInt(uint32_t constantID, int32_t value);
+        void setBool(uint32_t constantID, bool value);
+
+        uint32_t getCount() const { return count; }
+
+        // entries needs getCount() elements. info points into this object
+        // and entries, both must outlive it.
+        void getInfo(VkSpecializationInfo &info, VkSpecializationMapEntry *entries) const;
+
+        bool operator==(const VKSpecialization &other) const;
+        uint64_t hash(uint64_t hash) const;
+
+    private:
+        void set(uint32_t constantID, uint32_t bits);
+
+        uint32_t count = 0;
+        uint32_t constantIDs[MAX_CONSTANTS] = {};
+        uint32_t values[MAX_CONSTANTS] = {};
+};
@@ -0,0 +1,82 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vk_uniform_ring_buffer.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void VKUniformRingBuffer::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                               VKMemoryAllocator *allocator,
+                               VkDeviceSize bytesPerFrame, uint32_t frameCount)
+{
+    this->device = device;
+    this->allocator = allocator;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    alignment = std::max<VkDeviceSize>(
+        properties.limits.minUniformBufferOffsetAlignment, 1);
+
+    regionSize = alignUp(bytesPerFrame, alignment);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = regionSize * frameCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device, &bufferInfo, VULKAN_CPU_ALLOCATOR, &buffer));
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+    uint32_t memoryTypeIndex = allocator->findMemoryType(
+        memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    assert(memoryTypeIndex != UINT32_MAX);  // no host coherent memory!
+
+    VK_CHECK(allocator->allocate(memRequirements, memoryTypeIndex, allocation));
+    VK_CHECK(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
+
+    regionBegin = 0;
+    head = 0;
+
+    return;
+}
+
+void VKUniformRingBuffer::destroy()
+{
+    LOGI("uniform ring buffer: %llu of %llu bytes per frame used at most",
+         (unsigned long long)highWaterMark, (unsigned long long)regionSize);
+
+    vkDestroyBuffer(device, buffer, VULKAN_CPU_ALLOCATOR);
+    allocator->free(allocation);
+    buffer = VK_NULL_HANDLE;
+
+    return;
+}
+
+void VKUniformRingBuffer::beginFrame(uint32_t frameIndex)
+{
+    regionBegin = regionSize * frameIndex;
+    assert(regionBegin + regionSize <= allocation.size);
+    head = 0;
+
+    return;
+}
+
+VKUniformSlice VKUniformRingBuffer::allocate(VkDeviceSize size)
+{
+    VkDeviceSize offset = head;
+    head = alignUp(offset + size, alignment);
+    assert(head <= regionSize);  // per frame uniform budget exceeded!
+    highWaterMark = std::max(highWaterMark, head);
+
+    VKUniformSlice slice;
+    slice.buffer = buffer;
+    slice.offset = (uint32_t)(regionBegin + offset);
+    slice.data = static_cast<uint8_t *>(allocation.mappedData) + regionBegin + offset;
+
+    return slice;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vk_memory_allocator.h"
+
+/*
+ * A piece of uniform data for the current frame. offset is meant to be
+ * passed as the dynamic offset of a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+ * binding, data points straight into mapped memory.
+ */
+struct VKUniformSlice {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    uint32_t offset = 0;
+    void *data = nullptr;
+};
+
+/*
+ * VKUniformRingBuffer is one persistently mapped, host coherent uniform
+ * buffer split into one region per frame in flight.
+ *
+ * beginFrame(frame) rewinds that frame's region, so it must only be called
+ * once the GPU is done with the frame (i.e. after the frame's VKFrameSync
+ * slot wait). allocate() is then a pointer bump inside the
+ * region, no vkMapMemory / vkUnmapMemory round-trip per update and no
+ * per-object buffer or allocation.
+ */
+class VKUniformRingBuffer
+{
+    public:
+        VKUniformRingBuffer() {};
+        ~VKUniformRingBuffer() {};
+
+        void init(VkPhysicalDevice physicalDevice, VkDevice device,
+                  VKMemoryAllocator *allocator, VkDeviceSize bytesPerFrame,
+                  uint32_t frameCount);
+        void destroy();
+
+        void beginFrame(uint32_t frameIndex);
+        VKUniformSlice allocate(VkDeviceSize size);
+
+        VkBuffer getBuffer() const { return buffer; }
+        VkDeviceSize getHighWaterMark() const { return highWaterMark; }
+
+    private:
+        VkDevice device = VK_NULL_HANDLE;
+        VKMemoryAllocator *allocator = nullptr;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VKAllocation allocation;
+
+        VkDeviceSize alignment = 256;
+        VkDeviceSize regionSize = 0;
+        VkDeviceSize regionBegin = 0;
+        VkDeviceSize head = 0;
+        VkDeviceSize highWaterMark = 0;
+};
@@ -0,0 +1,254 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vk_upload_manager.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void VKUploadManager::init(VkDevice device, VKMemoryAllocator *allocator,
+                           uint32_t queueFamilyIndex,
+                           VkQueue queue, bool useTimeline, VkDeviceSize stagingSize)
+{
+    this->device = device;
+    this->allocator = allocator;
+    this->queue = queue;
+    this->stagingSize = stagingSize;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, VULKAN_CPU_ALLOCATOR, &commandPool));
+
+    VkCommandBuffer commandBuffers[MAX_BATCHES];
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = MAX_BATCHES;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers));
+
+    for (uint32_t i = 0; i < MAX_BATCHES; i++) {
+        batches[i] = Batch{};
+        batches[i].commandBuffer = commandBuffers[i];
+    }
+    sync.init(device, useTimeline, MAX_BATCHES);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = stagingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device, &bufferInfo, VULKAN_CPU_ALLOCATOR, &stagingBuffer));
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
+    uint32_t memoryTypeIndex = allocator->findMemoryType(
+        memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    assert(memoryTypeIndex != UINT32_MAX);  // no host coherent memory!
+
+    VK_CHECK(allocator->allocate(memRequirements, memoryTypeIndex, stagingAllocation));
+    VK_CHECK(vkBindBufferMemory(device, stagingBuffer, stagingAllocation.memory,
+                                stagingAllocation.offset));
+
+    stagingHead = 0;
+    stagingUsed = 0;
+    currentToken = 1;
+    completedToken = 0;
+
+    return;
+}
+
+void VKUploadManager::destroy()
+{
+    flush();
+    while (retireOldest(true)) {
+    }
+
+    LOGI("upload manager: %llu bytes in %u batches, %u stalls on a full staging ring",
+         (unsigned long long)bytesUploaded, batchesSubmitted, stalls);
+
+    for (uint32_t i = 0; i < MAX_BATCHES; i++) {
+        batches[i] = Batch{};
+    }
+    sync.destroy();
+    vkDestroyCommandPool(device, commandPool, VULKAN_CPU_ALLOCATOR);
+
+    vkDestroyBuffer(device, stagingBuffer, VULKAN_CPU_ALLOCATOR);
+    allocator->free(stagingAllocation);
+    stagingBuffer = VK_NULL_HANDLE;
+
+    return;
+}
+
+/*
+ * Frees the staging range and the batch slot of the oldest submitted batch.
+ * Batches are retired in submission order, so the freed range is always the
+ * tail of the staging ring.
+ */
+bool VKUploadManager::retireOldest(bool block)
+{
+    if (completedToken + 1 >= currentToken) {
+        return false;  // nothing in flight
+    }
+
+    Batch &batch = getBatch(completedToken + 1);
+    if (block) {
+        sync.wait(completedToken + 1);
+    } else if (!sync.isComplete(completedToken + 1)) {
+        return false;
+    }
+
+    stagingUsed -= batch.stagingBytes;
+    batch.stagingBytes = 0;
+    batch.copyCount = 0;
+    completedToken++;
+
+    return true;
+}
+
+void VKUploadManager::beginBatch()
+{
+    Batch &batch = getBatch(currentToken);
+    if (batch.recording) {
+        return;
+    }
+
+    // the slot is shared with the batch MAX_BATCHES tokens back.
+    while (currentToken - completedToken > MAX_BATCHES) {
+        retireOldest(true);
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo));
+    batch.recording = true;
+
+    return;
+}
+
+/*
+ * Reserves size bytes at the head of the staging ring. When the range does
+ * not fit before the end of the buffer the head wraps to 0, and the skipped
+ * tail is accounted to the batch as well so it is released with it.
+ */
+VkDeviceSize VKUploadManager::reserveStaging(VkDeviceSize size)
+{
+    assert(size <= stagingSize);
+
+    VkDeviceSize offset = 0;
+    VkDeviceSize padding = 0;
+    while (true) {
+        if (stagingUsed == 0) {
+            stagingHead = 0;
+        }
+
+        offset = alignUp(stagingHead, 16);
+        if (offset + size > stagingSize) {
+            offset = 0;
+        }
+        padding = offset >= stagingHead ? offset - stagingHead
+                                        : stagingSize - stagingHead;
+
+        if (stagingUsed + padding + size <= stagingSize) {
+            break;
+        }
+
+        if (!retireOldest(false)) {
+            stalls++;
+            if (completedToken + 1 >= currentToken) {
+                // only the batch being recorded holds staging memory.
+                flush();
+            }
+            retireOldest(true);
+        }
+    }
+
+    beginBatch();
+
+    Batch &batch = getBatch(currentToken);
+    batch.stagingBytes += padding + size;
+    stagingUsed += padding + size;
+    stagingHead = offset + size;
+
+    return offset;
+}
+
+VKUploadToken VKUploadManager::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset,
+                                            const void *data, VkDeviceSize size)
+{
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+
+    // uploads bigger than the ring are split, so they stream through it.
+    VkDeviceSize maxChunk = stagingSize / 2;
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, maxChunk);
+        VkDeviceSize offset = reserveStaging(chunk);
+
+        memcpy(static_cast<uint8_t *>(stagingAllocation.mappedData) + offset, src, chunk);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = offset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = chunk;
+
+        Batch &batch = getBatch(currentToken);
+        vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+        batch.copyCount++;
+
+        bytesUploaded += chunk;
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+
+    return currentToken;
+}
+
+VKUploadToken VKUploadManager::flush()
+{
+    Batch &batch = getBatch(currentToken);
+    if (!batch.recording) {
+        return currentToken - 1;
+    }
+
+    VK_CHECK(vkEndCommandBuffer(batch.commandBuffer));
+    batch.recording = false;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    VKUploadToken token = sync.submit(queue, currentToken % MAX_BATCHES, submitInfo);
+    assert(token == currentToken);  // every submit of the queue goes through flush()
+    batchesSubmitted++;
+
+    return currentToken++;
+}
+
+bool VKUploadManager::isComplete(VKUploadToken token)
+{
+    while (retireOldest(false)) {
+    }
+
+    return token <= completedToken;
+}
+
+void VKUploadManager::wait(VKUploadToken token)
+{
+    if (token >= currentToken) {
+        flush();
+    }
+
+    while (completedToken < token && retireOldest(true)) {
+    }
+
+    return;
+}
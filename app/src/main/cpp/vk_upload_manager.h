@@ -0,0 +1,86 @@
+#pragma once
+
+#include "vk_memory_allocator.h"
+#include "vk_frame_sync.h"
+
+/*
+ * Identifies the batch an upload was recorded into. A token is the value the
+ * batch signals on the upload queue's VKFrameSync, so tokens grow
+ * monotonically and every token <= a completed one is complete too.
+ */
+typedef uint64_t VKUploadToken;
+
+/*
+ * VKUploadManager streams data into device local buffers.
+ *
+ * Source data is copied into one persistently mapped staging buffer used as a
+ * ring, and the vkCmdCopyBuffer commands are recorded into the current batch.
+ * flush() submits the batch (one command buffer) and every upload recorded
+ * into it shares the returned token. Batch slots and staging ranges are
+ * released once their token has completed. Nothing blocks until the ring or
+ * the batch slots run out, in which case the oldest batch is waited on.
+ *
+ * Uploads are submitted to the queue given to init(), ideally one of a
+ * dedicated transfer family. Destination buffers must then be created with
+ * VK_SHARING_MODE_CONCURRENT between the transfer and the graphics family, so
+ * no queue family ownership transfer is needed.
+ *
+ * Not thread safe, all calls are expected to come from the render thread.
+ */
+class VKUploadManager
+{
+    public:
+        VKUploadManager() {};
+        ~VKUploadManager() {};
+
+        void init(VkDevice device, VKMemoryAllocator *allocator, uint32_t queueFamilyIndex,
+                  VkQueue queue, bool useTimeline,
+                  VkDeviceSize stagingSize = 8 * 1024 * 1024);
+        void destroy();
+
+        // stages size bytes of data, the copy into dstBuffer happens once the
+        // returned token's batch is flushed and executed.
+        VKUploadToken uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset,
+                                   const void *data, VkDeviceSize size);
+        // submits the current batch, returns the token of the last submitted batch.
+        VKUploadToken flush();
+
+        bool isComplete(VKUploadToken token);
+        void wait(VKUploadToken token);
+
+    private:
+        static const uint32_t MAX_BATCHES = 4;
+
+        struct Batch {
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkDeviceSize stagingBytes = 0;
+            uint32_t copyCount = 0;
+            bool recording = false;
+        };
+
+        Batch &getBatch(VKUploadToken token) { return batches[token % MAX_BATCHES]; }
+        void beginBatch();
+        VkDeviceSize reserveStaging(VkDeviceSize size);
+        bool retireOldest(bool block);
+
+        VkDevice device = VK_NULL_HANDLE;
+        VKMemoryAllocator *allocator = nullptr;
+        VkQueue queue = VK_NULL_HANDLE;
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VKFrameSync sync;
+
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VKAllocation stagingAllocation;
+        VkDeviceSize stagingSize = 0;
+        VkDeviceSize stagingHead = 0;
+        VkDeviceSize stagingUsed = 0;
+
+        Batch batches[MAX_BATCHES];
+        // token of the batch being recorded, all tokens below it are submitted.
+        VKUploadToken currentToken = 1;
+        VKUploadToken completedToken = 0;
+
+        uint64_t bytesUploaded = 0;
+        uint32_t batchesSubmitted = 0;
+        uint32_t stalls = 0;
+};
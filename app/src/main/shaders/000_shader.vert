@@ -6,23 +6,34 @@ layout(location = 0) out vec3 fragColor;
 // Uniform buffer containing an MVP matrix.
 // Currently the vulkan backend only sets the rotation matix
 // required to handle device rotation.
+// clearColor is the colour of the animated background.
 layout(binding = 0) uniform UniformBufferObject {
     mat4 MVP;
+    vec4 clearColor;
 } ubo;
 
-vec2 positions[3] = vec2[](
+// 0..2: the triangle, 3..5: one triangle covering the whole screen.
+vec2 positions[6] = vec2[](
     vec2(0.0, -0.5),
     vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
+    vec2(-0.5, 0.5),
+    vec2(-1.0, -1.0),
+    vec2(3.0, -1.0),
+    vec2(-1.0, 3.0)
 );
 
-vec3 colors[3] = vec3[](
-    vec3(0.67, 0.1, 0.2),
-    vec3(0.67, 0.1, 0.2),
-    vec3(0.67, 0.1, 0.2)
-);
+// color of the triangle, set by the app (SPEC_CONSTANT_COLOR_R/G/B).
+layout(constant_id = 2) const float COLOR_R = 0.67;
+layout(constant_id = 3) const float COLOR_G = 0.1;
+layout(constant_id = 4) const float COLOR_B = 0.2;
 
 void main() {
+    if (gl_VertexIndex >= 3) {
+        // the background needs no rotation, it covers the screen either way.
+        gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+        fragColor = ubo.clearColor.rgb;
+        return;
+    }
     gl_Position = ubo.MVP * vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    fragColor = vec3(COLOR_R, COLOR_G, COLOR_B);
+}
@@ -13,8 +13,21 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 MVP;
 } ubo;
 
+// gl_PointSize, set by the app (SPEC_CONSTANT_POINT_SIZE).
+layout(constant_id = 0) const float POINT_SIZE = 20.0;
+// 0: inColor, 1: the COLOR constants (SPEC_CONSTANT_COLOR_MODE). Each
+// pipeline variant only keeps one of the branches.
+layout(constant_id = 1) const int COLOR_MODE = 0;
+layout(constant_id = 2) const float COLOR_R = 1.0;
+layout(constant_id = 3) const float COLOR_G = 1.0;
+layout(constant_id = 4) const float COLOR_B = 1.0;
+
 void main() {
     gl_Position = ubo.MVP * vec4(inPos.xyz, 1.0);
-    gl_PointSize = 20.0f;
-    fragColor = inColor;
+    gl_PointSize = POINT_SIZE;
+    if (COLOR_MODE == 1) {
+        fragColor = vec3(COLOR_R, COLOR_G, COLOR_B);
+    } else {
+        fragColor = inColor;
+    }
 }
\ No newline at end of file
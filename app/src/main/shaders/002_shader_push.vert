@@ -0,0 +1,32 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+
+// Colour passed to the fragment shader
+layout(location = 0) out vec3 fragColor;
+
+// The MVP of the draw, pushed with vkCmdPushConstants (PushConstantObject).
+// No uniform buffer, so the pipeline layout has no descriptor set.
+layout(push_constant) uniform PushConstantObject {
+    mat4 MVP;
+} pc;
+
+// gl_PointSize, set by the app (SPEC_CONSTANT_POINT_SIZE).
+layout(constant_id = 0) const float POINT_SIZE = 20.0;
+// 0: inColor, 1: the COLOR constants (SPEC_CONSTANT_COLOR_MODE). Each
+// pipeline variant only keeps one of the branches.
+layout(constant_id = 1) const int COLOR_MODE = 0;
+layout(constant_id = 2) const float COLOR_R = 1.0;
+layout(constant_id = 3) const float COLOR_G = 1.0;
+layout(constant_id = 4) const float COLOR_B = 1.0;
+
+void main() {
+    gl_Position = pc.MVP * vec4(inPos.xyz, 1.0);
+    gl_PointSize = POINT_SIZE;
+    if (COLOR_MODE == 1) {
+        fragColor = vec3(COLOR_R, COLOR_G, COLOR_B);
+    } else {
+        fragColor = inColor;
+    }
+}
\ No newline at end of file